@@ -0,0 +1,320 @@
+#include "poly_vector.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <variant>
+#include <vector>
+
+// Compares PolyVector against the usual ways of storing polymorphic objects.
+// Every layout holds the same deterministic mix of small, medium and large
+// objects, so the numbers differ only by memory layout and dispatch.
+
+namespace {
+
+struct Shape {
+  virtual ~Shape() = default;
+  virtual uint64_t value() const = 0;
+};
+
+template <size_t Words> struct Sized final : Shape {
+  explicit Sized(uint64_t seed) {
+    for (auto &word : data)
+      word = seed++;
+  }
+
+  uint64_t value() const override { return data[0] ^ data[Words - 1]; }
+
+  uint64_t data[Words];
+};
+
+using Small = Sized<1>;  // 16 bytes with the vtable pointer
+using Medium = Sized<7>; // 64 bytes
+using Large = Sized<31>; // 256 bytes
+
+enum class Kind : uint8_t { small, medium, large };
+
+// 60% small, 30% medium and 10% large, scattered by a multiplicative hash
+Kind kind_at(size_t index) {
+  uint32_t bucket = static_cast<uint32_t>(index * 2654435761u) >> 16;
+  bucket %= 10;
+  return bucket < 6 ? Kind::small : bucket < 9 ? Kind::medium : Kind::large;
+}
+
+template <typename Function>
+decltype(auto) with_kind(Kind kind, Function &&fn) {
+  switch (kind) {
+  case Kind::small:
+    return fn.template operator()<Small>();
+  case Kind::medium:
+    return fn.template operator()<Medium>();
+  default:
+    return fn.template operator()<Large>();
+  }
+}
+
+struct PolyLayout {
+  somm::PolyVector<Shape> objects;
+  // emplace() puts a replacement in whichever free slot fits it best, so
+  // replace() tracks where each element went. at() is only used before any
+  // replace().
+  std::vector<size_t> slots;
+
+  void insert(Kind kind, uint64_t seed) {
+    with_kind(kind, [&]<typename T>() {
+      slots.push_back(objects.emplace_back<T>(seed));
+    });
+  }
+
+  template <typename Function> void for_each(Function &&fn) {
+    for (auto &object : objects)
+      fn(object.value());
+  }
+
+  uint64_t at(size_t index) { return objects[index]->value(); }
+
+  void replace(size_t index, Kind kind, uint64_t seed) {
+    objects.free(slots[index]);
+    with_kind(kind,
+              [&]<typename T>() { slots[index] = objects.emplace<T>(seed); });
+  }
+};
+
+struct UniquePtrLayout {
+  std::vector<std::unique_ptr<Shape>> objects;
+
+  void insert(Kind kind, uint64_t seed) {
+    with_kind(kind, [&]<typename T>() {
+      objects.emplace_back(std::make_unique<T>(seed));
+    });
+  }
+
+  template <typename Function> void for_each(Function &&fn) {
+    for (auto &object : objects)
+      fn(object->value());
+  }
+
+  uint64_t at(size_t index) { return objects[index]->value(); }
+
+  void replace(size_t index, Kind kind, uint64_t seed) {
+    objects[index].reset();
+    with_kind(kind, [&]<typename T>() {
+      objects[index] = std::make_unique<T>(seed);
+    });
+  }
+};
+
+struct VariantLayout {
+  std::vector<std::variant<Small, Medium, Large>> objects;
+
+  void insert(Kind kind, uint64_t seed) {
+    with_kind(kind, [&]<typename T>() {
+      objects.emplace_back(std::in_place_type<T>, seed);
+    });
+  }
+
+  template <typename Function> void for_each(Function &&fn) {
+    for (auto &object : objects)
+      fn(std::visit([](auto &shape) { return shape.value(); }, object));
+  }
+
+  uint64_t at(size_t index) {
+    return std::visit([](auto &shape) { return shape.value(); },
+                      objects[index]);
+  }
+
+  void replace(size_t index, Kind kind, uint64_t seed) {
+    with_kind(kind, [&]<typename T>() { objects[index].emplace<T>(seed); });
+  }
+};
+
+// One vector per type plus the (type, position) of every element, the layout
+// an ECS would use. Iteration walks the type vectors and ignores the order.
+// Each type vector keeps the element index of every entry, so an element
+// can be removed by moving the last entry of its type into its place.
+struct PerTypeLayout {
+  std::vector<Small> smalls;
+  std::vector<Medium> mediums;
+  std::vector<Large> larges;
+  std::vector<uint32_t> small_owners;
+  std::vector<uint32_t> medium_owners;
+  std::vector<uint32_t> large_owners;
+  std::vector<std::pair<Kind, uint32_t>> order;
+
+  template <typename T> std::vector<T> &of() {
+    if constexpr (std::is_same_v<T, Small>)
+      return smalls;
+    else if constexpr (std::is_same_v<T, Medium>)
+      return mediums;
+    else
+      return larges;
+  }
+
+  template <typename T> std::vector<uint32_t> &owners_of() {
+    if constexpr (std::is_same_v<T, Small>)
+      return small_owners;
+    else if constexpr (std::is_same_v<T, Medium>)
+      return medium_owners;
+    else
+      return large_owners;
+  }
+
+  void insert(Kind kind, uint64_t seed) {
+    add(static_cast<uint32_t>(order.size()), kind, seed);
+  }
+
+  template <typename Function> void for_each(Function &&fn) {
+    for (auto &shape : smalls)
+      fn(shape.value());
+    for (auto &shape : mediums)
+      fn(shape.value());
+    for (auto &shape : larges)
+      fn(shape.value());
+  }
+
+  uint64_t at(size_t index) {
+    auto [kind, position] = order[index];
+    return with_kind(
+        kind, [&]<typename T>() { return of<T>()[position].value(); });
+  }
+
+  // Removes the element from its type vector and appends the replacement to
+  // the vector of the new type, like the other layouts
+  void replace(size_t index, Kind kind, uint64_t seed) {
+    auto [old_kind, position] = order[index];
+    with_kind(old_kind, [&]<typename T>() {
+      std::vector<T> &objects = of<T>();
+      std::vector<uint32_t> &owners = owners_of<T>();
+      if (position + 1 != objects.size()) {
+        objects[position] = std::move(objects.back());
+        owners[position] = owners.back();
+        order[owners[position]].second = position;
+      }
+      objects.pop_back();
+      owners.pop_back();
+    });
+    add(static_cast<uint32_t>(index), kind, seed);
+  }
+
+  void add(uint32_t index, Kind kind, uint64_t seed) {
+    with_kind(kind, [&]<typename T>() {
+      std::pair<Kind, uint32_t> entry(kind,
+                                      static_cast<uint32_t>(of<T>().size()));
+      if (index == order.size())
+        order.push_back(entry);
+      else
+        order[index] = entry;
+      of<T>().emplace_back(seed);
+      owners_of<T>().push_back(index);
+    });
+  }
+};
+
+template <typename Layout> void fill(Layout &layout, size_t count) {
+  for (size_t index = 0; index < count; ++index) {
+    layout.insert(kind_at(index), index);
+  }
+}
+
+std::vector<size_t> random_indices(size_t count, size_t bound) {
+  std::mt19937_64 rng(42);
+  std::uniform_int_distribution<size_t> pick(0, bound - 1);
+  std::vector<size_t> indices(count);
+  for (auto &index : indices)
+    index = pick(rng);
+  return indices;
+}
+
+template <typename Layout> void BM_Insert(benchmark::State &state) {
+  size_t count = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    auto layout = std::make_unique<Layout>();
+    fill(*layout, count);
+    benchmark::DoNotOptimize(layout.get());
+    state.PauseTiming();
+    layout.reset();
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Layout> void BM_Iterate(benchmark::State &state) {
+  size_t count = static_cast<size_t>(state.range(0));
+  Layout layout;
+  fill(layout, count);
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    layout.for_each([&](uint64_t value) { sum += value; });
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+template <typename Layout> void BM_RandomAccess(benchmark::State &state) {
+  size_t count = static_cast<size_t>(state.range(0));
+  Layout layout;
+  fill(layout, count);
+  std::vector<size_t> indices = random_indices(count, count);
+  for (auto _ : state) {
+    uint64_t sum = 0;
+    for (size_t index : indices)
+      sum += layout.at(index);
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Replaces a quarter of the elements per iteration with objects of another
+// size. Every layout destroys the element and inserts the replacement:
+// PolyVector frees the slot and emplaces into its free lists.
+template <typename Layout> void BM_Churn(benchmark::State &state) {
+  size_t count = static_cast<size_t>(state.range(0));
+  Layout layout;
+  fill(layout, count);
+  std::vector<size_t> indices = random_indices(count / 4, count);
+  uint64_t seed = 0;
+  for (auto _ : state) {
+    for (size_t index : indices) {
+      ++seed;
+      layout.replace(index, kind_at(index + seed), seed);
+    }
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() *
+                          static_cast<int64_t>(indices.size()));
+}
+
+template <typename Layout> void BM_Destroy(benchmark::State &state) {
+  size_t count = static_cast<size_t>(state.range(0));
+  for (auto _ : state) {
+    state.PauseTiming();
+    auto layout = std::make_unique<Layout>();
+    fill(*layout, count);
+    state.ResumeTiming();
+    layout.reset();
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+void counts(benchmark::internal::Benchmark *benchmark) {
+  benchmark->RangeMultiplier(10)->Range(1'000, 10'000'000);
+  benchmark->Unit(benchmark::kMicrosecond);
+}
+
+#define POLY_VECTOR_BENCH_LAYOUTS(bench)                                       \
+  BENCHMARK_TEMPLATE(bench, PolyLayout)->Apply(counts);                        \
+  BENCHMARK_TEMPLATE(bench, UniquePtrLayout)->Apply(counts);                   \
+  BENCHMARK_TEMPLATE(bench, VariantLayout)->Apply(counts);                     \
+  BENCHMARK_TEMPLATE(bench, PerTypeLayout)->Apply(counts)
+
+POLY_VECTOR_BENCH_LAYOUTS(BM_Insert);
+POLY_VECTOR_BENCH_LAYOUTS(BM_Iterate);
+POLY_VECTOR_BENCH_LAYOUTS(BM_RandomAccess);
+POLY_VECTOR_BENCH_LAYOUTS(BM_Churn);
+POLY_VECTOR_BENCH_LAYOUTS(BM_Destroy);
+
+} // namespace
+
+BENCHMARK_MAIN();
@@ -1,14 +1,39 @@
 #ifndef POLY_VECTOR_H
 #define POLY_VECTOR_H
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
+#include <initializer_list>
+#include <limits>
+#include <map>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <ranges>
+#include <set>
+#include <span>
 #include <stdexcept>
 #include <string>
+#include <tuple>
 #include <type_traits>
+#include <typeinfo>
+#include <utility>
 #include <vector>
 
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define SOMM_HAS_VIRTUAL_STORAGE 1
+#endif
+
 namespace somm {
 
 template <typename Base, typename Derived> constexpr void assert_must_derive() {
@@ -21,337 +46,3675 @@ using poly_data_t = uintptr_t; // Size of the vtable pointer defines the minimum
 inline constexpr uint8_t poly_data_byte_scale =
     (sizeof(poly_data_t) == 8) ? 3 : 2;
 
-template <typename Base> class PolyVector {
+// Types that may be moved to a new address with memcpy. Polymorphic types are
+// never trivially copyable, so specialize this to std::true_type for types
+// without self-referencing members (no SSO std::string, no intrusive lists)
+// to relocate them with memcpy instead of a move constructor.
+template <typename T>
+struct is_trivially_relocatable
+    : std::bool_constant<std::is_trivially_copyable_v<T>> {};
+
+template <typename T>
+inline constexpr bool is_trivially_relocatable_v =
+    is_trivially_relocatable<T>::value;
+
+// Bytes rounded up to whole poly_data_t units
+constexpr size_t poly_data_words(size_t bytes) noexcept {
+  return (bytes + sizeof(poly_data_t) - 1) >> poly_data_byte_scale;
+}
+
+// First set bit >= index in an occupancy bitmap of words 64-bit words, or
+// end. Empty words are skipped four at a time so long freed runs cost one
+// load per 256 slots.
+inline size_t next_set_bit(const uint64_t *bits, size_t words, size_t index,
+                           size_t end) noexcept {
+  size_t word = index >> 6;
+  if (word >= words)
+    return end;
+
+  uint64_t word_bits = bits[word] & (~uint64_t(0) << (index & 63));
+  while (word_bits == 0) {
+    if (++word >= words)
+      return end;
+    while (word + 4 <= words &&
+           (bits[word] | bits[word + 1] | bits[word + 2] | bits[word + 3]) ==
+               0) {
+      word += 4;
+    }
+    if (word >= words)
+      return end;
+    word_bits = bits[word];
+  }
+
+  return (word << 6) + static_cast<size_t>(std::countr_zero(word_bits));
+}
+
+// Sets the bits of [first, last) a word at a time
+inline void set_bit_range(uint64_t *bits, size_t first, size_t last) noexcept {
+  while (first < last) {
+    size_t count = std::min<size_t>(64 - (first & 63), last - first);
+    uint64_t mask = (count == 64)
+                        ? ~uint64_t(0)
+                        : ((uint64_t(1) << count) - 1) << (first & 63);
+    bits[first >> 6] |= mask;
+    first += count;
+  }
+}
+
+// Last set bit <= index, or size_t(-1)
+inline size_t prev_set_bit(const uint64_t *bits, size_t index) noexcept {
+  size_t word = index >> 6;
+  uint64_t word_bits = bits[word] & (~uint64_t(0) >> (63 - (index & 63)));
+  while (word_bits == 0) {
+    if (word-- == 0)
+      return size_t(-1);
+    word_bits = bits[word];
+  }
+
+  return (word << 6) + 63 - static_cast<size_t>(std::countl_zero(word_bits));
+}
+
+// ranks[w] = set bits in words [0, w) of a bitmap, for w in [0, words]
+inline void rank_bits(const uint64_t *bits, size_t words,
+                      uint64_t *ranks) noexcept {
+  uint64_t count = 0;
+  for (size_t word = 0; word < words; ++word) {
+    ranks[word] = count;
+    count += static_cast<uint64_t>(std::popcount(bits[word]));
+  }
+  ranks[words] = count;
+}
+
+// Position of the set bit with the given rank, which must be less than
+// ranks[words]: a binary search over the ranks of rank_bits(), then a scan
+// of one word
+inline size_t select_bit(const uint64_t *bits, const uint64_t *ranks,
+                         size_t words, size_t rank) noexcept {
+  size_t word = static_cast<size_t>(
+      std::upper_bound(ranks, ranks + words + 1, rank) - ranks - 1);
+  uint64_t word_bits = bits[word];
+  for (size_t skip = rank - ranks[word]; skip > 0; --skip)
+    word_bits &= word_bits - 1;
+  return (word << 6) + static_cast<size_t>(std::countr_zero(word_bits));
+}
+
+// Default-initializes elements that a container value-initializes, so
+// growing a std::vector of trivial types leaves the new space unwritten.
+// Constructors with arguments go through Alloc as usual.
+template <typename T, typename Alloc = std::allocator<T>>
+class DefaultInitAllocator : public Alloc {
+  using traits = std::allocator_traits<Alloc>;
+
 public:
-  static_assert(std::is_abstract<Base>(),
-                "Base class must be an abstract class");
-  using buffer_offset_t = size_t;
-  using free_index_t = buffer_offset_t;
+  template <typename U> struct rebind {
+    using other =
+        DefaultInitAllocator<U, typename traits::template rebind_alloc<U>>;
+  };
 
-  struct Iterator {
-    using iterator_category = std::forward_iterator_tag;
-    using value_type = Base;
-    using difference_type = std::ptrdiff_t;
-    using pointer = Base *;
-    using reference = Base &;
+  using Alloc::Alloc;
 
-    Iterator(PolyVector *vector, size_t index)
-        : poly_vec(vector), m_index(index) {
-      skip_nulls();
-    }
+  DefaultInitAllocator() = default;
 
-    pointer operator->() const { return &**this; }
+  template <typename Other>
+    requires std::is_constructible_v<Alloc, const Other &>
+  DefaultInitAllocator(const Other &alloc) noexcept : Alloc(alloc) {}
+
+  template <typename U>
+  void construct(U *ptr) noexcept(std::is_nothrow_default_constructible_v<U>) {
+    ::new (static_cast<void *>(ptr)) U;
+  }
 
-    reference operator*() const {
-      if (m_index >= poly_vec->size()) {
-        throw std::out_of_range(
-            "somm::PolyVector::Iterator dereference: Resource at index: " +
-            std::to_string(m_index) + "is freed");
+  template <typename U, typename... Args>
+  void construct(U *ptr, Args &&...args) {
+    traits::construct(static_cast<Alloc &>(*this), ptr,
+                      std::forward<Args>(args)...);
+  }
+};
+
+template <typename Alloc, typename T>
+using rebind_alloc_t =
+    typename std::allocator_traits<Alloc>::template rebind_alloc<T>;
+
+// The largest alignment a storage policy guarantees: a page on every supported
+// target
+inline constexpr size_t page_alignment = 4096;
+
+// Pass to set_min_alignment() of a vector whose storage guarantees it to keep
+// neighbouring elements off each other's cache lines
+inline constexpr size_t cache_line_size = 64;
+
+// Hands out storage for T aligned to Alignment bytes by allocating through
+// Alloc rebound to an over-aligned block type, whose alignment std::allocator
+// and std::pmr::polymorphic_allocator both honour. Sizes are rounded up to
+// whole blocks.
+template <typename T, size_t Alignment, typename Alloc = std::allocator<T>>
+class AlignedAllocator {
+  struct alignas(Alignment) block_t {
+    std::byte bytes[Alignment];
+  };
+  using block_alloc_t = rebind_alloc_t<Alloc, block_t>;
+  using block_traits = std::allocator_traits<block_alloc_t>;
+
+  template <typename, size_t, typename> friend class AlignedAllocator;
+
+public:
+  using value_type = T;
+  using propagate_on_container_copy_assignment =
+      typename block_traits::propagate_on_container_copy_assignment;
+  using propagate_on_container_move_assignment =
+      typename block_traits::propagate_on_container_move_assignment;
+  using propagate_on_container_swap =
+      typename block_traits::propagate_on_container_swap;
+  using is_always_equal = typename block_traits::is_always_equal;
+
+  template <typename U> struct rebind {
+    using other = AlignedAllocator<U, Alignment, rebind_alloc_t<Alloc, U>>;
+  };
+
+  AlignedAllocator() = default;
+
+  template <typename Other>
+    requires std::is_constructible_v<block_alloc_t, const Other &>
+  AlignedAllocator(const Other &alloc) noexcept : m_alloc(alloc) {}
+
+  template <typename U, typename OtherAlloc>
+  AlignedAllocator(
+      const AlignedAllocator<U, Alignment, OtherAlloc> &other) noexcept
+      : m_alloc(other.m_alloc) {}
+
+  T *allocate(size_t n) {
+    return reinterpret_cast<T *>(block_traits::allocate(m_alloc, blocks(n)));
+  }
+
+  void deallocate(T *ptr, size_t n) noexcept {
+    block_traits::deallocate(m_alloc, reinterpret_cast<block_t *>(ptr),
+                             blocks(n));
+  }
+
+  AlignedAllocator select_on_container_copy_construction() const {
+    return AlignedAllocator(
+        block_traits::select_on_container_copy_construction(m_alloc));
+  }
+
+  bool operator==(const AlignedAllocator &other) const noexcept {
+    return m_alloc == other.m_alloc;
+  }
+
+private:
+  static constexpr size_t blocks(size_t n) noexcept {
+    return (n * sizeof(T) + Alignment - 1) / Alignment;
+  }
+
+  block_alloc_t m_alloc;
+};
+
+// Storage policies decide how the data buffer of a PolyVector is laid out.
+// buffer_type<Alloc> is indexed in poly_data_t units, offsets_type<Alloc,
+// Offset> holds the offset table, both constructible from the PolyVector
+// allocator.
+// max_alignment is the largest object alignment the buffer start guarantees.
+// stable_addresses is false when growing the buffer may move it. place()
+// moves an already aligned start offset forward so that an object of the
+// given number of words never crosses a boundary the buffer cannot store
+// contiguously.
+
+// One contiguous std::vector. Growth reallocates and moves every object, but
+// the appended space is not zero-filled since the object is constructed into
+// it right after. Allocations are rounded up to whole MaxAlignment blocks, so
+// ContiguousStorage<page_alignment> takes at least a page.
+template <size_t MaxAlignment = alignof(std::max_align_t)>
+struct ContiguousStorage {
+  static_assert(std::has_single_bit(MaxAlignment) &&
+                    MaxAlignment >= alignof(poly_data_t),
+                "MaxAlignment must be a power of two no smaller than a word");
+  static constexpr size_t max_alignment = MaxAlignment;
+  template <typename Alloc>
+  using buffer_type = std::vector<
+      poly_data_t,
+      DefaultInitAllocator<
+          poly_data_t, AlignedAllocator<poly_data_t, max_alignment,
+                                        rebind_alloc_t<Alloc, poly_data_t>>>>;
+  template <typename Alloc, typename Offset>
+  using offsets_type = std::vector<Offset, rebind_alloc_t<Alloc, Offset>>;
+  static constexpr size_t max_object_words = SIZE_MAX;
+  static constexpr bool stable_addresses = false;
+
+  static constexpr size_t place(size_t start, size_t) noexcept {
+    return start;
+  }
+};
+
+// A list of fixed-size pages that are never moved once allocated, so growth
+// keeps every element address stable. An offset encodes (page, word) as
+// page * PageWords + word, and objects never straddle two pages.
+template <size_t PageWords = 4096> struct PagedStorage {
+  static_assert(std::has_single_bit(PageWords),
+                "PageWords must be a power of two");
+  static constexpr size_t page_shift = std::countr_zero(PageWords);
+  static constexpr size_t page_mask = PageWords - 1;
+  static constexpr size_t max_object_words = PageWords;
+  static constexpr size_t max_alignment =
+      std::min(page_alignment, PageWords * sizeof(poly_data_t));
+  static constexpr bool stable_addresses = true;
+  template <typename Alloc, typename Offset>
+  using offsets_type = std::vector<Offset, rebind_alloc_t<Alloc, Offset>>;
+
+  static constexpr size_t place(size_t start, size_t words) noexcept {
+    if ((start & page_mask) + words > PageWords)
+      return (start + page_mask) & ~page_mask;
+    return start;
+  }
+
+  // Pages are allocated uninitialized through Alloc
+  template <typename Alloc> class buffer_type {
+    using page_alloc_t = AlignedAllocator<poly_data_t, max_alignment,
+                                          rebind_alloc_t<Alloc, poly_data_t>>;
+    using page_traits = std::allocator_traits<page_alloc_t>;
+    using pages_t =
+        std::vector<poly_data_t *, rebind_alloc_t<Alloc, poly_data_t *>>;
+
+  public:
+    buffer_type() noexcept = default;
+
+    explicit buffer_type(const Alloc &alloc) noexcept
+        : m_alloc(alloc), m_pages(alloc) {}
+
+    buffer_type(const buffer_type &other)
+        : m_alloc(page_traits::select_on_container_copy_construction(
+              other.m_alloc)),
+          m_pages(std::allocator_traits<typename pages_t::allocator_type>::
+                      select_on_container_copy_construction(
+                          other.m_pages.get_allocator())),
+          m_size(other.m_size) {
+      m_pages.reserve(other.m_pages.size());
+      for (auto *page : other.m_pages) {
+        add_page();
+        std::memcpy(m_pages.back(), page, PageWords * sizeof(poly_data_t));
       }
+    }
 
-      return *(*poly_vec)[m_index];
-    };
+    buffer_type &operator=(const buffer_type &other) {
+      if (this != &other)
+        *this = buffer_type(other);
+      return *this;
+    }
 
-    Iterator &operator++() {
-      ++m_index;
-      skip_nulls();
+    // The allocator always travels with the pages it allocated
+    buffer_type(buffer_type &&other) noexcept
+        : m_alloc(other.m_alloc), m_pages(std::move(other.m_pages)),
+          m_size(std::exchange(other.m_size, 0)) {}
+
+    buffer_type &operator=(buffer_type &&other) noexcept {
+      std::swap(m_alloc, other.m_alloc);
+      std::swap(m_pages, other.m_pages);
+      std::swap(m_size, other.m_size);
       return *this;
     }
 
-    Iterator operator++(int) {
-      Iterator temp = *this;
-      ++(*this);
-      return temp;
+    ~buffer_type() noexcept { release_pages(0); }
+
+    poly_data_t &operator[](size_t offset) noexcept {
+      return m_pages[offset >> page_shift][offset & page_mask];
     }
 
-    bool operator==(const Iterator &other) const {
-      return poly_vec == other.poly_vec && m_index == other.m_index;
+    const poly_data_t &operator[](size_t offset) const noexcept {
+      return m_pages[offset >> page_shift][offset & page_mask];
     }
 
-    bool operator!=(const Iterator &other) const { return !(*this == other); }
+    size_t size() const noexcept { return m_size; }
 
-  private:
-    void skip_nulls() {
-      while (m_index < poly_vec->size() && (*poly_vec)[m_index] == nullptr) {
-        ++m_index;
-      }
+    static constexpr size_t max_size() noexcept {
+      return SIZE_MAX & ~page_mask;
     }
 
-    PolyVector *poly_vec;
-    size_t m_index;
-  };
+    size_t page_count() const noexcept { return m_pages.size(); }
 
-  Iterator begin() {
-    if (empty())
-      return end();
-    return {this, 0};
-  }
+    poly_data_t *page_data(size_t page) noexcept { return m_pages[page]; }
 
-  Iterator end() { return {this, size()}; }
+    // Never moves allocated pages, only appends new ones
+    void resize(size_t words) {
+      reserve(words);
+      m_size = words;
+    }
 
-  Iterator back() { return {this, (size()) ? size() - 1 : 0}; }
+    void reserve(size_t words) {
+      while ((m_pages.size() << page_shift) < words) {
+        add_page();
+      }
+    }
 
-  PolyVector() noexcept = default;
+    void clear() noexcept { m_size = 0; }
 
-  ~PolyVector() noexcept {
-    for (auto &object : *this) {
-      object.~Base();
+    void shrink_to_fit() {
+      release_pages((m_size + page_mask) >> page_shift);
+      m_pages.shrink_to_fit();
     }
-  }
 
-  PolyVector(const PolyVector &other) noexcept
-      : m_buffer(other.m_buffer), m_offsets(other.m_offsets),
-        m_free_indices(other.m_free_indices) {}
+  private:
+    void add_page() {
+      poly_data_t *page = page_traits::allocate(m_alloc, PageWords);
+      try {
+        m_pages.emplace_back(page);
+      } catch (...) {
+        page_traits::deallocate(m_alloc, page, PageWords);
+        throw;
+      }
+    }
 
-  PolyVector &operator=(const PolyVector &other) noexcept {
-    m_buffer = other.m_buffer;
-    m_offsets = other.m_offsets;
-    m_free_indices = other.m_free_indices;
-    return this;
-  }
+    void release_pages(size_t keep) noexcept {
+      while (m_pages.size() > keep) {
+        page_traits::deallocate(m_alloc, m_pages.back(), PageWords);
+        m_pages.pop_back();
+      }
+    }
 
-  PolyVector(const PolyVector &&other) noexcept
-      : m_buffer(std::move(other.m_buffer)),
-        m_offsets(std::move(other.m_offsets)),
-        m_free_indices(std::move(other.m_free_indices)) {}
+    page_alloc_t m_alloc;
+    pages_t m_pages;
+    size_t m_size = 0;
+  };
+};
 
-  PolyVector &operator=(const PolyVector &&other) noexcept {
-    m_buffer = std::move(other.m_buffer);
-    m_offsets = std::move(other.m_offsets);
-    m_free_indices = std::move(other.m_free_indices);
-    return *this;
-  }
+#ifdef SOMM_HAS_VIRTUAL_STORAGE
+// An array of trivially copyable T inside an address range reserved once
+// with mmap(PROT_NONE). Growth commits more of the range in place, so the
+// data never moves and new elements are not value-initialized. clear()
+// hands the pages back to the OS with madvise but keeps the reservation.
+template <typename T, size_t MaxElements> class VirtualArray {
+public:
+  static_assert(std::is_trivially_copyable_v<T>,
+                "VirtualArray only holds trivially copyable types");
+  static constexpr size_t reserved_bytes = MaxElements * sizeof(T);
 
-  // Ignore m_offsets.back() since it does not contain any data until next
-  // insert_at_end()
-  size_t size() const noexcept { return m_offsets.size() - 1; }
+  VirtualArray() noexcept = default;
 
-  bool empty() const noexcept { return m_free_indices.size() == size(); }
+  // Memory comes from mmap, the allocator of the owning container is unused
+  template <typename Alloc>
+    requires requires { typename Alloc::value_type; }
+  explicit VirtualArray(const Alloc &) noexcept {}
 
-  size_t max_size() const noexcept {
-    return (m_buffer.size() << poly_data_byte_scale) / sizeof(Base);
+  VirtualArray(std::initializer_list<T> init) {
+    resize(init.size());
+    std::copy(init.begin(), init.end(), m_data);
   }
 
-  poly_data_t *buffer_data() noexcept { return m_buffer.data(); }
-
-  poly_data_t *offset_data() noexcept { return m_offsets.data(); }
-
-  poly_data_t *free_indices_data() noexcept { return m_free_indices.data(); }
+  VirtualArray(const VirtualArray &other) {
+    resize(other.m_size);
+    if (m_size)
+      std::memcpy(m_data, other.m_data, m_size * sizeof(T));
+  }
 
-  void clear() noexcept {
-    m_buffer.clear();
-    m_offsets.resize(
-        1); // We always need the first element for insertion to work
-    m_free_indices.clear();
+  VirtualArray &operator=(const VirtualArray &other) {
+    if (this != &other) {
+      resize(other.m_size);
+      if (m_size)
+        std::memcpy(m_data, other.m_data, m_size * sizeof(T));
+    }
+    return *this;
   }
 
-  Base *operator[](size_t index) noexcept {
-    auto &buffer_data = m_buffer[m_offsets[index]];
-    if (reinterpret_cast<poly_data_t &>(buffer_data) == free_space)
-      return nullptr;
+  VirtualArray(VirtualArray &&other) noexcept
+      : m_data(std::exchange(other.m_data, nullptr)),
+        m_size(std::exchange(other.m_size, 0)),
+        m_committed(std::exchange(other.m_committed, 0)) {}
 
-    return reinterpret_cast<Base *>(&buffer_data);
+  VirtualArray &operator=(VirtualArray &&other) noexcept {
+    std::swap(m_data, other.m_data);
+    std::swap(m_size, other.m_size);
+    std::swap(m_committed, other.m_committed);
+    return *this;
   }
 
-  Base *at(size_t index) {
-    check_bounds("at()", index);
-    return (*this)[index];
+  ~VirtualArray() noexcept {
+    if (m_data)
+      munmap(m_data, reserved_bytes);
   }
 
-  inline bool is_free(size_t index) const {
-    check_bounds("is_free()", index);
-    return (*this)[index] == nullptr;
-  }
+  T &operator[](size_t index) noexcept { return m_data[index]; }
+  const T &operator[](size_t index) const noexcept { return m_data[index]; }
 
-  size_t size_at(size_t index) const {
-    check_bounds("size_at()", index);
-    return (m_offsets[index + 1] - m_offsets[index]) << poly_data_byte_scale;
-  }
+  T *data() noexcept { return m_data; }
+  const T *data() const noexcept { return m_data; }
 
-  size_t offset_at(size_t index) {
-    check_bounds("offset_at()", index);
-    return m_offsets[index];
+  T &back() noexcept { return m_data[m_size - 1]; }
+  const T &back() const noexcept { return m_data[m_size - 1]; }
+
+  size_t size() const noexcept { return m_size; }
+  size_t capacity() const noexcept { return m_committed / sizeof(T); }
+  static constexpr size_t max_size() noexcept { return MaxElements; }
+
+  // New elements are left as whatever the committed pages hold: zero for
+  // fresh or released pages, stale values when shrinking and growing again
+  void resize(size_t n) {
+    reserve(n);
+    m_size = n;
   }
 
-  void free(size_t index) {
-    check_bounds("free()", index);
-    m_free_indices.emplace_back(index);
-    auto *object = reinterpret_cast<Base *>(&m_buffer[m_offsets[index]]);
-    object->~Base();
-    *reinterpret_cast<poly_data_t *>(object) =
-        free_space; // Zeroed the vtable-pointer
+  void emplace_back(T value) {
+    reserve(m_size + 1);
+    m_data[m_size++] = value;
   }
 
-  void free_all() {
-    for (auto &object : *this) {
-      object.~Base();
-      reinterpret_cast<poly_data_t &>(object) =
-          free_space; // Zeroed the vtable-pointer
+  // Commits at least n elements, doubling so growth costs O(log n) syscalls
+  void reserve(size_t n) {
+    if (n * sizeof(T) <= m_committed)
+      return;
+    if (n > MaxElements)
+      throw std::length_error("somm::VirtualArray::reserve: " +
+                              std::to_string(n) +
+                              " elements exceed the reservation");
+    if (m_data == nullptr) {
+      void *range = mmap(nullptr, reserved_bytes, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (range == MAP_FAILED)
+        throw std::bad_alloc();
+      m_data = static_cast<T *>(range);
     }
 
-    m_offsets.resize(
-        1); // We always need the first element for insertion to work
-    m_free_indices.clear();
+    size_t bytes = std::min(
+        page_round(std::max(n * sizeof(T), m_committed * 2)), reserved_bytes);
+    if (mprotect(reinterpret_cast<char *>(m_data) + m_committed,
+                 bytes - m_committed, PROT_READ | PROT_WRITE) != 0)
+      throw std::bad_alloc();
+    m_committed = bytes;
   }
 
-  // An evil function that goes against the philisophy of the class. A
-  // PolyVector should never shrink, no element should ever be moved or
-  // destroyed. PolyVector should only be able to grow or be cleared.
-  // void erase_back() {
-  //   if (size() <= 1)
-  //     return;
-  //   m_buffer.erase(m_buffer.begin() +
-  //                      static_cast<std::ptrdiff_t>((m_offsets.back() - 1)),
-  //                  m_buffer.end());
-  //   m_offsets.pop_back();
-  // }
+  void clear() noexcept {
+    m_size = 0;
+    if (m_committed)
+      madvise(m_data, m_committed, MADV_DONTNEED);
+  }
 
+  // Decommits every page past the last element
   void shrink_to_fit() noexcept {
-    m_buffer.shrink_to_fit();
-    m_offsets.shrink_to_fit();
-    m_free_indices.shrink_to_fit();
+    size_t bytes = page_round(m_size * sizeof(T));
+    if (bytes >= m_committed)
+      return;
+    char *tail = reinterpret_cast<char *>(m_data) + bytes;
+    madvise(tail, m_committed - bytes, MADV_DONTNEED);
+    mprotect(tail, m_committed - bytes, PROT_NONE);
+    m_committed = bytes;
   }
 
-  void reserve_buffer(size_t bytes) {
-    size_t datas = bytes << poly_data_byte_scale;
-    m_buffer.reserve(datas);
+private:
+  static size_t page_round(size_t bytes) noexcept {
+    static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return (bytes + page - 1) & ~(page - 1);
   }
 
-  void reserve_elements(size_t n) {
-    m_offsets.reserve(n);
-    m_free_indices.reserve(n);
-  }
+  T *m_data = nullptr;
+  size_t m_size = 0;
+  size_t m_committed = 0; // Bytes readable and writable from m_data
+};
 
-  template <typename Derived> size_t push_back(const Derived &object) noexcept {
-    assert_must_derive<Base, Derived>();
-    return buffer_write_back(
-        [&](buffer_offset_t start) {
-          new (&m_buffer[start]) Derived(
-              object); /* Does not work if copy constructor is deleted */
-        },
-        sizeof(Derived), alignof(Derived));
+// Reserves ReserveBytes of address space for the buffer (and enough for one
+// offset per word) on first use and commits it as the vector grows. Growth
+// never copies, element addresses stay stable, and the total size is capped
+// by the reservation. Only the occupancy bitmap uses the allocator.
+template <size_t ReserveBytes = size_t(1) << 32> struct VirtualStorage {
+  static constexpr size_t reserved_words = ReserveBytes / sizeof(poly_data_t);
+  static_assert(reserved_words > 0, "ReserveBytes must hold one poly_data_t");
+  static constexpr size_t max_object_words = reserved_words;
+  static constexpr size_t max_alignment = page_alignment; // From mmap
+  static constexpr bool stable_addresses = true;
+  template <typename Alloc>
+  using buffer_type = VirtualArray<poly_data_t, reserved_words>;
+  // Every object takes at least one word, plus the trailing end offset
+  template <typename Alloc, typename Offset>
+  using offsets_type = VirtualArray<Offset, reserved_words + 1>;
+
+  static constexpr size_t place(size_t start, size_t) noexcept {
+    return start;
   }
+};
 
-  template <typename Derived> size_t push(const Derived &object) noexcept {
-    assert_must_derive<Base, Derived>();
-    return buffer_write(
-        [&](buffer_offset_t start) {
-          new (&m_buffer[start]) Derived(
-              object); /* Does not work if copy constructor is deleted */
-        },
-        sizeof(Derived), alignof(Derived));
+// A whole file mapped read-only, for PolyVector::load()
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+      throw std::runtime_error("somm::MappedFile: cannot open " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+      ::close(fd);
+      throw std::runtime_error("somm::MappedFile: cannot stat " + path);
+    }
+    m_size = static_cast<size_t>(info.st_size);
+    if (m_size != 0) {
+      void *data = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("somm::MappedFile: cannot map " + path);
+      }
+      m_data = static_cast<const std::byte *>(data);
+      madvise(data, m_size, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
   }
 
-  template <typename Derived, typename... Args>
-  size_t emplace_back(Args &&...args) noexcept {
-    assert_must_derive<Base, Derived>();
-    return buffer_write_back(
-        [&](buffer_offset_t start) {
-          new (&m_buffer[start]) Derived(std::forward<Args>(args)...);
-        },
-        sizeof(Derived), alignof(Derived));
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+
+  ~MappedFile() noexcept {
+    if (m_data)
+      munmap(const_cast<std::byte *>(m_data), m_size);
   }
 
+  const std::byte *data() const noexcept { return m_data; }
+  size_t size() const noexcept { return m_size; }
+
+private:
+  const std::byte *m_data = nullptr;
+  size_t m_size = 0;
+};
+#endif
+
+// Stable IDs for the types a PolyVector image may hold. PolyVector::save()
+// writes each object's ID in place of its vtable pointer and load() writes
+// the vtable pointer of the running process back. Objects are restored
+// byte for byte without running a constructor, so only trivially
+// relocatable types can be registered, and their members must not point
+// into memory that does not survive the process.
+template <typename Base> class TypeRegistry {
+public:
+  using type_id_t = uint32_t;
+
+  struct Entry {
+    type_id_t id;
+    const std::type_info *type;
+    poly_data_t vptr;
+    size_t size;
+    size_t alignment;
+  };
+
+  // Constructs one Derived from args to read its vtable pointer
   template <typename Derived, typename... Args>
-  size_t emplace(Args &&...args) noexcept {
+  void add(type_id_t id, const Args &...args) {
     assert_must_derive<Base, Derived>();
-    return buffer_write(
-        [&](buffer_offset_t start) {
-          new (&m_buffer[start]) Derived(std::forward<Args>(args)...);
-        },
-        sizeof(Derived), alignof(Derived));
-  }
+    static_assert(is_trivially_relocatable_v<Derived>,
+                  "Only trivially relocatable types can be restored from an "
+                  "image");
+    if (find(id) != nullptr || find(typeid(Derived)) != nullptr) {
+      throw std::invalid_argument("somm::TypeRegistry::add(): id " +
+                                  std::to_string(id) + " or type " +
+                                  typeid(Derived).name() +
+                                  " is already registered");
+    }
 
-  // Memplace: Memcopies object data into buffer without calling constructor
+    alignas(Derived) std::byte sample[sizeof(Derived)];
+    auto *object = new (sample) Derived(args...);
+    poly_data_t vptr;
+    std::memcpy(&vptr, sample, sizeof(vptr));
+    object->~Derived();
+    m_entries.push_back(
+        {id, &typeid(Derived), vptr, sizeof(Derived), alignof(Derived)});
+  }
 
-  size_t memplace_back(const Base &object, size_t size,
-                       size_t alignment) noexcept {
-    return buffer_write_back(
-        [&](buffer_offset_t start) {
-          std::memcpy(&m_buffer[start], static_cast<const void *>(&object),
-                      size);
-        },
-        size, alignment);
+  const Entry *find(type_id_t id) const noexcept {
+    for (auto &entry : m_entries) {
+      if (entry.id == id)
+        return &entry;
+    }
+    return nullptr;
   }
 
-  size_t memplace(const Base &object, size_t size, size_t alignment) noexcept {
-    return buffer_write(
-        [&](buffer_offset_t start) {
-          std::memcpy(&m_buffer[start], static_cast<const void *>(&object),
-                      size);
-        },
-        size, alignment);
+  const Entry *find(const std::type_info &type) const noexcept {
+    for (auto &entry : m_entries) {
+      if (*entry.type == type)
+        return &entry;
+    }
+    return nullptr;
   }
 
 private:
-  static constexpr poly_data_t free_space = 0;
+  std::vector<Entry> m_entries;
+};
 
-  template <typename WriterFunction>
-  size_t buffer_write_back(WriterFunction &&write, size_t size,
-                           size_t alignment) noexcept {
-    // The last object's end is my start
-    buffer_offset_t &start = m_offsets.back();
-    // Can give the tail of the pervious element some extra buffer space. But
-    // it does not matter since it is cast to a smaller Base type when
-    // returned
-    start = align(start, alignment >> poly_data_byte_scale);
-    buffer_offset_t end = start + (size >> poly_data_byte_scale);
-    if (start > end)
-      return this->size();
+// An immutable PolyVector made by PolyVector::freeze(). The live objects are
+// packed at their own alignment, freed indices keep their number as empty
+// slots, and one allocation holds the buffer, the offset table, the
+// occupancy bitmap and a rank table of the live elements before each bitmap
+// word. Only const access is offered and nothing is written after freeze(),
+// so any number of threads may read it without synchronization.
+template <typename Base, typename Offset = size_t> class FrozenPolyVector {
+public:
+  using buffer_offset_t = Offset;
+  using occupancy_word_t = uint64_t;
 
-    m_buffer.resize(end);
-    write(start);
-    m_offsets.emplace_back(end);
+  // Random access over the live elements. n steps cost a binary search over
+  // the rank table, or nothing when no index is freed; ++ and -- scan the
+  // bitmap.
+  struct Iterator {
+    using iterator_category = std::random_access_iterator_tag;
+    using iterator_concept = std::random_access_iterator_tag;
+    using value_type = Base;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Base *;
+    using reference = const Base &;
 
-    return this->size();
-  }
+    Iterator() noexcept = default;
 
-  template <typename WriterFunction>
-  size_t buffer_write(WriterFunction &&write, size_t size,
-                      size_t alignment) noexcept {
-    for (auto &index : m_free_indices) {
-      buffer_offset_t start = m_offsets[index];
-      if (start != align(start, static_cast<buffer_offset_t>(
-                                    alignment >> poly_data_byte_scale))) {
-        continue;
-      }
+    Iterator(const FrozenPolyVector *vector, size_t rank) noexcept
+        : frozen_vec(vector), m_rank(rank), m_index(vector->select(rank)) {}
 
-      // Never out of bounds because m_offsets.back() is an extra element
-      // without an end, representing a space for the next insert_at_end()
-      buffer_offset_t end = m_offsets[index + 1];
-      if (end - start < (size >> poly_data_byte_scale))
-        continue;
+    size_t index() const noexcept { return m_index; }
 
-      index = m_free_indices.back();
-      m_free_indices.pop_back();
-      write(start);
+    pointer operator->() const noexcept { return &**this; }
 
-      return index;
+    reference operator*() const noexcept {
+      return frozen_vec->object_at(m_index);
     }
 
-    return buffer_write_back(write, size, alignment);
-  }
+    reference operator[](difference_type n) const noexcept {
+      return *(*this + n);
+    }
 
-  inline void check_bounds(const char *caller, size_t index) {
-    if (index >= size()) {
-      throw std::out_of_range("somm::PolyVector::" + std::string(caller) +
-                              ": index " + std::to_string(index) +
-                              " not less than size " + std::to_string(size()));
+    Iterator &operator++() noexcept {
+      ++m_rank;
+      m_index = frozen_vec->next_live(m_index + 1);
+      return *this;
     }
-  }
 
-  static inline buffer_offset_t align(buffer_offset_t offset,
-                                      buffer_offset_t alignment) noexcept {
-    return (offset + alignment - 1) & ~(alignment - 1);
-  }
+    Iterator operator++(int) noexcept {
+      Iterator temp = *this;
+      ++(*this);
+      return temp;
+    }
 
-  // free_indices[i] : index -> offsets[index] : offset -> buffer[offset] :
-  // data
-  std::vector<poly_data_t> m_buffer = {0};
-  std::vector<buffer_offset_t> m_offsets = {0};
-  std::vector<free_index_t> m_free_indices;
-};
+    Iterator &operator--() noexcept {
+      --m_rank;
+      m_index = prev_set_bit(frozen_vec->m_occupancy, m_index - 1);
+      return *this;
+    }
 
-} // namespace somm
+    Iterator operator--(int) noexcept {
+      Iterator temp = *this;
+      --(*this);
+      return temp;
+    }
+
+    Iterator &operator+=(difference_type n) noexcept {
+      m_rank = static_cast<size_t>(static_cast<difference_type>(m_rank) + n);
+      m_index = frozen_vec->select(m_rank);
+      return *this;
+    }
+
+    Iterator &operator-=(difference_type n) noexcept { return *this += -n; }
+
+    friend Iterator operator+(Iterator it, difference_type n) noexcept {
+      return it += n;
+    }
+
+    friend Iterator operator+(difference_type n, Iterator it) noexcept {
+      return it += n;
+    }
+
+    friend Iterator operator-(Iterator it, difference_type n) noexcept {
+      return it -= n;
+    }
+
+    friend difference_type operator-(const Iterator &a,
+                                     const Iterator &b) noexcept {
+      return static_cast<difference_type>(a.m_rank) -
+             static_cast<difference_type>(b.m_rank);
+    }
+
+    bool operator==(const Iterator &other) const noexcept {
+      return m_rank == other.m_rank;
+    }
+
+    auto operator<=>(const Iterator &other) const noexcept {
+      return m_rank <=> other.m_rank;
+    }
+
+  private:
+    const FrozenPolyVector *frozen_vec = nullptr;
+    size_t m_rank = 0; // Live elements before this one
+    size_t m_index = 0;
+  };
+
+  using iterator = Iterator;
+  using const_iterator = Iterator;
+
+  FrozenPolyVector() noexcept = default;
+
+  FrozenPolyVector(const FrozenPolyVector &) = delete;
+  FrozenPolyVector &operator=(const FrozenPolyVector &) = delete;
+
+  FrozenPolyVector(FrozenPolyVector &&other) noexcept { swap(other); }
+
+  FrozenPolyVector &operator=(FrozenPolyVector &&other) noexcept {
+    if (this != &other) {
+      release();
+      swap(other);
+    }
+    return *this;
+  }
+
+  ~FrozenPolyVector() noexcept { release(); }
+
+  Iterator begin() const noexcept { return {this, 0}; }
+  Iterator end() const noexcept { return {this, live_count()}; }
+
+  // Indices, freed ones included, as in the vector that was frozen
+  size_t size() const noexcept { return m_size; }
+
+  bool empty() const noexcept { return m_free_count == m_size; }
+
+  size_t free_count() const noexcept { return m_free_count; }
+
+  size_t live_count() const noexcept { return m_size - m_free_count; }
+
+  // The whole allocation: buffer, offsets, bitmap and rank table
+  size_t memory_bytes() const noexcept { return m_bytes; }
+
+  bool read_only() const noexcept { return m_read_only; }
+
+  const Base *operator[](size_t index) const noexcept {
+    if (!is_live(index))
+      return nullptr;
+
+    return &object_at(index);
+  }
+
+  const Base *at(size_t index) const {
+    check_bounds("at()", index);
+    return (*this)[index];
+  }
+
+  bool is_free(size_t index) const {
+    check_bounds("is_free()", index);
+    return !is_live(index);
+  }
+
+  size_t size_at(size_t index) const {
+    check_bounds("size_at()", index);
+    return (m_offsets[index + 1] - m_offsets[index]) << poly_data_byte_scale;
+  }
+
+  // Calls fn(const Base &) on every live element in index order
+  template <typename Function> void for_each(Function &&fn) const {
+    for_each_in_range(0, m_size, fn);
+  }
+
+  // Calls fn(const Base &) on every live element with an index in
+  // [first, last)
+  template <typename Function>
+  void for_each_in_range(size_t first, size_t last, Function &&fn) const {
+    last = std::min(last, m_size);
+    for (size_t index = next_live(first); index < last;
+         index = next_live(index + 1)) {
+      fn(object_at(index));
+    }
+  }
+
+  void swap(FrozenPolyVector &other) noexcept {
+    std::swap(m_data, other.m_data);
+    std::swap(m_bytes, other.m_bytes);
+    std::swap(m_size, other.m_size);
+    std::swap(m_free_count, other.m_free_count);
+    std::swap(m_buffer, other.m_buffer);
+    std::swap(m_offsets, other.m_offsets);
+    std::swap(m_occupancy, other.m_occupancy);
+    std::swap(m_ranks, other.m_ranks);
+    std::swap(m_read_only, other.m_read_only);
+  }
+
+private:
+  template <typename, typename, typename, typename> friend class PolyVector;
+
+  // Lays out the allocation for size indices and buffer_words of objects.
+  // The buffer comes first so it starts on a page.
+  FrozenPolyVector(size_t size, size_t buffer_words) : m_size(size) {
+    size_t words = (size + 63) >> 6;
+    size_t offsets_bytes =
+        ((size + 1) * sizeof(Offset) + sizeof(uint64_t) - 1) &
+        ~(sizeof(uint64_t) - 1);
+    size_t buffer_bytes = buffer_words << poly_data_byte_scale;
+    m_bytes = buffer_bytes + offsets_bytes + (2 * words + 1) * sizeof(uint64_t);
+    m_data = allocate(m_bytes);
+    m_buffer = reinterpret_cast<poly_data_t *>(m_data);
+    m_offsets = reinterpret_cast<Offset *>(m_data + buffer_bytes);
+    m_occupancy =
+        reinterpret_cast<occupancy_word_t *>(m_data + buffer_bytes +
+                                             offsets_bytes);
+    m_ranks = m_occupancy + words;
+  }
+
+  // Counts the live elements once the bitmap is filled in
+  void build_ranks() noexcept {
+    size_t words = (m_size + 63) >> 6;
+    rank_bits(m_occupancy, words, m_ranks);
+    m_free_count = m_size - m_ranks[words];
+  }
+
+  // Maps the allocation read-only where mprotect() is available, so a
+  // stray write through a const_cast faults
+  void protect() {
+#ifdef SOMM_HAS_VIRTUAL_STORAGE
+    if (m_data && mprotect(m_data, m_bytes, PROT_READ) != 0)
+      throw std::runtime_error("somm::FrozenPolyVector: mprotect failed");
+    m_read_only = true;
+#endif
+  }
+
+  static std::byte *allocate(size_t bytes) {
+#ifdef SOMM_HAS_VIRTUAL_STORAGE
+    void *data = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+      throw std::bad_alloc();
+    return static_cast<std::byte *>(data);
+#else
+    return static_cast<std::byte *>(
+        ::operator new(bytes, std::align_val_t(page_alignment)));
+#endif
+  }
+
+  // Destructors write the vtable pointer, so the pages are made writable
+  // again first
+  void release() noexcept {
+    if (!m_data)
+      return;
+#ifdef SOMM_HAS_VIRTUAL_STORAGE
+    if (m_read_only)
+      mprotect(m_data, m_bytes, PROT_READ | PROT_WRITE);
+#endif
+    for (size_t index = next_live(0); index < m_size;
+         index = next_live(index + 1)) {
+      const_cast<Base &>(object_at(index)).~Base();
+    }
+#ifdef SOMM_HAS_VIRTUAL_STORAGE
+    munmap(m_data, m_bytes);
+#else
+    ::operator delete(m_data, std::align_val_t(page_alignment));
+#endif
+    m_data = nullptr;
+    m_size = 0;
+    m_free_count = 0;
+  }
+
+  // Index of the live element of the given rank, or size()
+  size_t select(size_t rank) const noexcept {
+    if (rank >= live_count())
+      return m_size;
+    if (m_free_count == 0)
+      return rank;
+
+    return select_bit(m_occupancy, m_ranks, (m_size + 63) >> 6, rank);
+  }
+
+  size_t next_live(size_t index) const noexcept {
+    return next_set_bit(m_occupancy, (m_size + 63) >> 6, index, m_size);
+  }
+
+  inline bool is_live(size_t index) const noexcept {
+    return (m_occupancy[index >> 6] >> (index & 63)) & 1;
+  }
+
+  inline const Base &object_at(size_t index) const noexcept {
+    return *reinterpret_cast<const Base *>(&m_buffer[m_offsets[index]]);
+  }
+
+  inline void check_bounds(const char *caller, size_t index) const {
+    if (index >= m_size) {
+      throw std::out_of_range("somm::FrozenPolyVector::" +
+                              std::string(caller) + ": index " +
+                              std::to_string(index) + " not less than size " +
+                              std::to_string(m_size));
+    }
+  }
+
+  std::byte *m_data = nullptr;
+  size_t m_bytes = 0;
+  size_t m_size = 0;
+  size_t m_free_count = 0;
+  poly_data_t *m_buffer = nullptr;
+  Offset *m_offsets = nullptr;
+  occupancy_word_t *m_occupancy = nullptr;
+  uint64_t *m_ranks = nullptr; // Live elements before each bitmap word
+  bool m_read_only = false;
+};
+
+template <typename Base, typename... Types> class ClosedPolyVector;
+
+// Offset is the integer type of the offset table. A narrower type such as
+// uint32_t halves the table but caps the buffer at its range in poly_data_t
+// units (32 GiB for uint32_t with 8-byte words).
+template <typename Base, typename Storage = ContiguousStorage<>,
+          typename Allocator = std::allocator<poly_data_t>,
+          typename Offset = size_t>
+class PolyVector {
+public:
+  static_assert(std::is_abstract<Base>(),
+                "Base class must be an abstract class");
+  static_assert(std::is_unsigned_v<Offset> &&
+                    sizeof(Offset) <= sizeof(size_t),
+                "Offset must be an unsigned integer no wider than size_t");
+  using allocator_type = Allocator;
+  using buffer_offset_t = Offset;
+  using free_index_t = buffer_offset_t;
+  using occupancy_word_t = uint64_t;
+  using generation_t = uint32_t;
+
+  // An index plus the generation its slot had when the handle was made.
+  // Freeing the slot bumps the generation, so the handle goes stale even if
+  // a later insert reuses the slot.
+  struct Handle {
+    buffer_offset_t index;
+    generation_t generation;
+
+    bool operator==(const Handle &other) const = default;
+  };
+
+  // Walks the live elements in index order, ConstIterator through a const
+  // vector. An Iterator converts to a ConstIterator.
+  template <bool Const> struct BasicIterator {
+    using vector_type = std::conditional_t<Const, const PolyVector, PolyVector>;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using value_type = Base;
+    using difference_type = std::ptrdiff_t;
+    using pointer = std::conditional_t<Const, const Base *, Base *>;
+    using reference = std::conditional_t<Const, const Base &, Base &>;
+
+    BasicIterator() = default;
+
+    BasicIterator(vector_type *vector, size_t index)
+        : poly_vec(vector), m_index(vector->next_live(index)) {
+      load_bits();
+    }
+
+    template <bool OtherConst>
+      requires(Const && !OtherConst)
+    BasicIterator(const BasicIterator<OtherConst> &other)
+        : poly_vec(other.poly_vec), m_index(other.m_index),
+          m_bits(other.m_bits) {}
+
+    size_t index() const noexcept { return m_index; }
+
+    pointer operator->() const { return &**this; }
+
+    // The iterator only ever stops on live indices, so the slot is not
+    // checked again
+    reference operator*() const { return poly_vec->object_at(m_index); }
+
+    BasicIterator &operator++() {
+      if (m_bits != 0) {
+        m_index = (m_index & ~size_t(63)) +
+                  static_cast<size_t>(std::countr_zero(m_bits));
+        m_bits &= m_bits - 1;
+      } else {
+        m_index = poly_vec->next_live((m_index | 63) + 1);
+        load_bits();
+      }
+      return *this;
+    }
+
+    BasicIterator operator++(int) {
+      BasicIterator temp = *this;
+      ++(*this);
+      return temp;
+    }
+
+    BasicIterator &operator--() {
+      m_index = poly_vec->prev_live(m_index - 1);
+      load_bits();
+      return *this;
+    }
+
+    BasicIterator operator--(int) {
+      BasicIterator temp = *this;
+      --(*this);
+      return temp;
+    }
+
+    bool operator==(const BasicIterator &other) const {
+      return poly_vec == other.poly_vec && m_index == other.m_index;
+    }
+
+    bool operator!=(const BasicIterator &other) const {
+      return !(*this == other);
+    }
+
+  private:
+    template <bool> friend struct BasicIterator;
+
+    // Only reads the occupancy bitmap, never the objects of freed slots.
+    // m_bits keeps the live bits of m_index's word above m_index, so ++
+    // reloads the bitmap once per word instead of once per element.
+    void load_bits() noexcept {
+      m_bits = (m_index < poly_vec->size())
+                   ? poly_vec->m_occupancy[m_index >> 6] &
+                         ~((occupancy_word_t(2) << (m_index & 63)) - 1)
+                   : 0;
+    }
+
+    vector_type *poly_vec = nullptr;
+    size_t m_index = 0;
+    occupancy_word_t m_bits = 0;
+  };
+
+  using Iterator = BasicIterator<false>;
+  using ConstIterator = BasicIterator<true>;
+  using iterator = Iterator;
+  using const_iterator = ConstIterator;
+
+  Iterator begin() {
+    if (empty())
+      return end();
+    return {this, 0};
+  }
+
+  Iterator end() { return {this, size()}; }
+
+  ConstIterator begin() const {
+    if (empty())
+      return end();
+    return {this, 0};
+  }
+
+  ConstIterator end() const { return {this, size()}; }
+
+  ConstIterator cbegin() const { return begin(); }
+
+  ConstIterator cend() const { return end(); }
+
+  Iterator back() { return {this, (size()) ? size() - 1 : 0}; }
+
+  // The live elements as a random-access sized range, so std::ranges
+  // algorithms, views::chunk and the parallel algorithms can split it
+  // without walking it. Making the view counts the live elements before
+  // each occupancy word, one word per 64 indices, and inserting or freeing
+  // invalidates it.
+  template <bool Const>
+  class LiveView : public std::ranges::view_interface<LiveView<Const>> {
+  public:
+    using vector_type = std::conditional_t<Const, const PolyVector, PolyVector>;
+
+    // n steps cost a binary search over the counts, or nothing when no
+    // index is freed. ++ and -- scan the bitmap.
+    struct Iterator {
+      using iterator_category = std::random_access_iterator_tag;
+      using iterator_concept = std::random_access_iterator_tag;
+      using value_type = Base;
+      using difference_type = std::ptrdiff_t;
+      using pointer = std::conditional_t<Const, const Base *, Base *>;
+      using reference = std::conditional_t<Const, const Base &, Base &>;
+
+      Iterator() = default;
+
+      Iterator(vector_type *vector, const uint64_t *ranks, size_t rank)
+          : poly_vec(vector), m_ranks(ranks), m_rank(rank),
+            m_index(vector ? select(rank) : 0) {}
+
+      size_t index() const noexcept { return m_index; }
+
+      pointer operator->() const noexcept { return &**this; }
+
+      reference operator*() const noexcept {
+        return *reinterpret_cast<pointer>(
+            &poly_vec->m_buffer[poly_vec->m_offsets[m_index]]);
+      }
+
+      reference operator[](difference_type n) const noexcept {
+        return *(*this + n);
+      }
+
+      Iterator &operator++() noexcept {
+        ++m_rank;
+        m_index = poly_vec->next_live(m_index + 1);
+        return *this;
+      }
+
+      Iterator operator++(int) noexcept {
+        Iterator temp = *this;
+        ++(*this);
+        return temp;
+      }
+
+      Iterator &operator--() noexcept {
+        --m_rank;
+        m_index = poly_vec->prev_live(m_index - 1);
+        return *this;
+      }
+
+      Iterator operator--(int) noexcept {
+        Iterator temp = *this;
+        --(*this);
+        return temp;
+      }
+
+      Iterator &operator+=(difference_type n) noexcept {
+        m_rank = static_cast<size_t>(static_cast<difference_type>(m_rank) + n);
+        m_index = select(m_rank);
+        return *this;
+      }
+
+      Iterator &operator-=(difference_type n) noexcept { return *this += -n; }
+
+      friend Iterator operator+(Iterator it, difference_type n) noexcept {
+        return it += n;
+      }
+
+      friend Iterator operator+(difference_type n, Iterator it) noexcept {
+        return it += n;
+      }
+
+      friend Iterator operator-(Iterator it, difference_type n) noexcept {
+        return it -= n;
+      }
+
+      friend difference_type operator-(const Iterator &a,
+                                       const Iterator &b) noexcept {
+        return static_cast<difference_type>(a.m_rank) -
+               static_cast<difference_type>(b.m_rank);
+      }
+
+      bool operator==(const Iterator &other) const noexcept {
+        return m_rank == other.m_rank;
+      }
+
+      auto operator<=>(const Iterator &other) const noexcept {
+        return m_rank <=> other.m_rank;
+      }
+
+    private:
+      // Index of the live element of the given rank, or size()
+      size_t select(size_t rank) const noexcept {
+        size_t words = poly_vec->m_occupancy.size();
+        if (rank >= m_ranks[words])
+          return poly_vec->size();
+        if (poly_vec->free_count() == 0)
+          return rank;
+        return select_bit(poly_vec->m_occupancy.data(), m_ranks, words, rank);
+      }
+
+      vector_type *poly_vec = nullptr;
+      const uint64_t *m_ranks = nullptr;
+      size_t m_rank = 0; // Live elements before this one
+      size_t m_index = 0;
+    };
+
+    LiveView() = default;
+
+    explicit LiveView(vector_type *vector) : m_vector(vector) {
+      size_t words = vector->m_occupancy.size();
+      auto ranks = std::make_shared<uint64_t[]>(words + 1);
+      rank_bits(vector->m_occupancy.data(), words, ranks.get());
+      m_ranks = std::move(ranks);
+    }
+
+    Iterator begin() const { return {m_vector, m_ranks.get(), 0}; }
+
+    Iterator end() const { return {m_vector, m_ranks.get(), size()}; }
+
+    size_t size() const noexcept {
+      return m_vector ? m_vector->size() - m_vector->free_count() : 0;
+    }
+
+  private:
+    vector_type *m_vector = nullptr;
+    // Shared so copying the view stays O(1)
+    std::shared_ptr<const uint64_t[]> m_ranks;
+  };
+
+  LiveView<false> live() { return LiveView<false>(this); }
+
+  LiveView<true> live() const { return LiveView<true>(this); }
+
+  // The live elements paired with their index, for
+  // for (auto [index, object] : vector.indexed()). The index is the
+  // iterator's own cursor, so neither a counter nor operator[] is needed.
+  // The pair is a proxy reference returned by value, which std::ranges
+  // accepts for a bidirectional iterator but the classic forward iterator
+  // requirements do not, hence the input iterator_category. Jumps would
+  // need the rank counts live() builds, so the view stays bidirectional.
+  template <bool Const>
+  class IndexedView : public std::ranges::view_interface<IndexedView<Const>> {
+  public:
+    using vector_type = std::conditional_t<Const, const PolyVector, PolyVector>;
+    using object_reference = std::conditional_t<Const, const Base &, Base &>;
+
+    struct Iterator {
+      using iterator_category = std::input_iterator_tag;
+      using iterator_concept = std::bidirectional_iterator_tag;
+      using value_type = std::pair<size_t, object_reference>;
+      using difference_type = std::ptrdiff_t;
+      using reference = value_type;
+
+      Iterator() = default;
+
+      Iterator(vector_type *vector, size_t index)
+          : poly_vec(vector), m_index(vector->next_live(index)) {}
+
+      reference operator*() const noexcept {
+        return {m_index, poly_vec->object_at(m_index)};
+      }
+
+      Iterator &operator++() noexcept {
+        m_index = poly_vec->next_live(m_index + 1);
+        return *this;
+      }
+
+      Iterator operator++(int) noexcept {
+        Iterator temp = *this;
+        ++(*this);
+        return temp;
+      }
+
+      Iterator &operator--() noexcept {
+        m_index = poly_vec->prev_live(m_index - 1);
+        return *this;
+      }
+
+      Iterator operator--(int) noexcept {
+        Iterator temp = *this;
+        --(*this);
+        return temp;
+      }
+
+      bool operator==(const Iterator &other) const noexcept {
+        return m_index == other.m_index;
+      }
+
+    private:
+      vector_type *poly_vec = nullptr;
+      size_t m_index = 0;
+    };
+
+    IndexedView() = default;
+
+    explicit IndexedView(vector_type *vector) noexcept : m_vector(vector) {}
+
+    Iterator begin() const { return {m_vector, 0}; }
+
+    Iterator end() const { return {m_vector, m_vector->size()}; }
+
+  private:
+    vector_type *m_vector = nullptr;
+  };
+
+  IndexedView<false> indexed() noexcept { return IndexedView<false>(this); }
+
+  IndexedView<true> indexed() const noexcept {
+    return IndexedView<true>(this);
+  }
+
+  PolyVector() noexcept : PolyVector(Allocator()) {}
+
+  // The allocator is rebound for the buffer and for every table the vector
+  // keeps beside it
+  explicit PolyVector(const Allocator &alloc) noexcept
+      : m_buffer(alloc), m_offsets(alloc), m_slot_words(alloc),
+        m_occupancy(alloc), m_free_regions(alloc),
+        m_free_lists(make_free_lists(alloc)), m_free_indices(alloc),
+        m_types(alloc), m_compact_order(alloc), m_generations(alloc) {
+    m_offsets.emplace_back(0); // The end of the last object
+  }
+
+  ~PolyVector() noexcept {
+    for (auto &object : *this) {
+      object.~Base();
+    }
+  }
+
+  // Copies the layout, so every index and handle of other refers to the
+  // same element in the copy. Each live object is copy-constructed over a
+  // bitwise copy of its slot, and objects added by memplace() or load() stay
+  // bitwise copies. Throws std::invalid_argument if a live object is not
+  // copy constructible.
+  PolyVector(const PolyVector &other)
+      : m_buffer(other.m_buffer), m_offsets(other.m_offsets),
+        m_slot_words(other.m_slot_words), m_occupancy(other.m_occupancy),
+        m_free_regions(other.m_free_regions),
+        m_free_lists(other.m_free_lists),
+        m_free_classes(other.m_free_classes),
+        m_free_indices(other.m_free_indices),
+        m_free_count(other.m_free_count),
+        m_free_bytes(other.m_free_bytes),
+        m_free_histogram(other.m_free_histogram), m_types(other.m_types),
+        m_relocated_types(other.m_relocated_types),
+        m_live_bytes(other.m_live_bytes),
+        m_compact_order(other.m_compact_order),
+        m_compact_end(other.m_compact_end),
+        m_compact_index(other.m_compact_index),
+        m_compact_cursor(other.m_compact_cursor),
+        m_generations(other.m_generations),
+        m_min_alignment(other.m_min_alignment) {
+    copy_objects(other);
+  }
+
+  PolyVector &operator=(const PolyVector &other) {
+    if (this != &other)
+      *this = PolyVector(other);
+    return *this;
+  }
+
+  // Takes other's storage, objects stay where they are, and leaves other
+  // empty
+  PolyVector(PolyVector &&other) noexcept
+      : PolyVector(other.get_allocator()) {
+    swap(other);
+  }
+
+  // Like std::vector, storage only changes hands when the allocator
+  // propagates or compares equal. Otherwise the objects are relocated into
+  // this vector's own storage.
+  PolyVector &operator=(PolyVector &&other) noexcept(
+      allocator_traits::propagate_on_container_move_assignment::value ||
+      allocator_traits::is_always_equal::value) {
+    if (this == &other)
+      return *this;
+    if (allocator_traits::propagate_on_container_move_assignment::value ||
+        get_allocator() == other.get_allocator()) {
+      PolyVector moved(std::move(other));
+      swap(moved);
+    } else {
+      PolyVector moved(get_allocator());
+      moved.relocate_from(other);
+      swap(moved);
+    }
+    return *this;
+  }
+
+  // Swaps the contents, which requires equal allocators like std::vector
+  void swap(PolyVector &other) noexcept {
+    using std::swap;
+    swap(m_buffer, other.m_buffer);
+    swap(m_offsets, other.m_offsets);
+    swap(m_slot_words, other.m_slot_words);
+    swap(m_occupancy, other.m_occupancy);
+    swap(m_free_regions, other.m_free_regions);
+    swap(m_free_lists, other.m_free_lists);
+    swap(m_free_classes, other.m_free_classes);
+    swap(m_free_indices, other.m_free_indices);
+    swap(m_free_count, other.m_free_count);
+    swap(m_free_bytes, other.m_free_bytes);
+    swap(m_free_histogram, other.m_free_histogram);
+    swap(m_types, other.m_types);
+    swap(m_relocated_types, other.m_relocated_types);
+    swap(m_live_bytes, other.m_live_bytes);
+    swap(m_compact_order, other.m_compact_order);
+    swap(m_compact_end, other.m_compact_end);
+    swap(m_compact_index, other.m_compact_index);
+    swap(m_compact_cursor, other.m_compact_cursor);
+    swap(m_generations, other.m_generations);
+    swap(m_min_alignment, other.m_min_alignment);
+  }
+
+  // Ignore m_offsets.back() since it does not contain any data until next
+  // insert_at_end()
+  size_t size() const noexcept { return m_offsets.size() - 1; }
+
+  bool empty() const noexcept { return m_free_count == size(); }
+
+  size_t free_count() const noexcept { return m_free_count; }
+
+  allocator_type get_allocator() const noexcept {
+    return allocator_type(m_occupancy.get_allocator());
+  }
+
+  size_t max_size() const noexcept {
+    return (m_buffer.size() << poly_data_byte_scale) / sizeof(Base);
+  }
+
+  poly_data_t *buffer_data() noexcept
+    requires requires(Storage::template buffer_type<Allocator> &buffer) {
+      buffer.data();
+    }
+  {
+    return m_buffer.data();
+  }
+
+  buffer_offset_t *offset_data() noexcept { return m_offsets.data(); }
+
+  void clear() noexcept {
+    m_buffer.clear();
+    m_offsets.resize(
+        1); // We always need the first element for insertion to work
+    m_offsets.back() = 0;
+    m_slot_words.clear();
+    m_occupancy.clear();
+    clear_free_lists();
+    clear_type_indices();
+    expire_handles();
+    m_live_bytes = 0;
+    m_compact_order.clear();
+    m_compact_index = not_compacting;
+  }
+
+  Base *operator[](size_t index) noexcept {
+    if (!is_live(index))
+      return nullptr;
+
+    return reinterpret_cast<Base *>(&m_buffer[m_offsets[index]]);
+  }
+
+  Base *at(size_t index) {
+    check_bounds("at()", index);
+    return (*this)[index];
+  }
+
+  const Base *operator[](size_t index) const noexcept {
+    return const_cast<PolyVector *>(this)->operator[](index);
+  }
+
+  const Base *at(size_t index) const {
+    check_bounds("at()", index);
+    return (*this)[index];
+  }
+
+  // The first handle() to an index starts tracking generations for it and
+  // every index below it, at the cost of a generation_t per slot
+  Handle handle(size_t index) {
+    check_bounds("handle()", index);
+    if (!is_live(index)) {
+      throw std::out_of_range("somm::PolyVector::handle(): index " +
+                              std::to_string(index) + " is freed");
+    }
+    if (index >= m_generations.size())
+      m_generations.resize(size());
+    return {static_cast<buffer_offset_t>(index), m_generations[index]};
+  }
+
+  // A bounds check and a compare, both on the generation table: a freed
+  // slot has a newer generation than any handle made to it. Only clear()
+  // and free_all() shrink size(), and they bump every generation, so an
+  // entry past size() never matches. The generation wraps after 2^32 frees
+  // of the same slot.
+  bool valid(Handle handle) const noexcept {
+    return handle.index < m_generations.size() &&
+           m_generations[handle.index] == handle.generation;
+  }
+
+  // nullptr when the handle is stale
+  Base *get(Handle handle) noexcept {
+    if (!valid(handle))
+      return nullptr;
+    return &object_at(handle.index);
+  }
+
+  inline bool is_free(size_t index) const {
+    check_bounds("is_free()", index);
+    return !is_live(index);
+  }
+
+  size_t size_at(size_t index) const {
+    check_bounds("size_at()", index);
+    return m_slot_words[index] << poly_data_byte_scale;
+  }
+
+  size_t offset_at(size_t index) {
+    check_bounds("offset_at()", index);
+    return m_offsets[index];
+  }
+
+  void free(size_t index) {
+    check_bounds("free()", index);
+    if (TypeRecord *type = find_type(vptr_at(index))) {
+      m_live_bytes -= type->size;
+      unmark_type(*type, index);
+    }
+    if (index < m_generations.size())
+      ++m_generations[index];
+    m_occupancy[index >> 6] &= ~(occupancy_word_t(1) << (index & 63));
+    destroy_at(index);
+    release_slot(index);
+  }
+
+  // Frees every index of indices, in any order, then returns their slots to
+  // the free regions in index order. Indices that are already free, or listed
+  // twice, are skipped. Throws std::out_of_range, freeing nothing, if an
+  // index is not less than size().
+  void free(std::span<const size_t> indices) {
+    for (size_t index : indices)
+      check_bounds("free()", index);
+
+    std::vector<FreedSlot> slots;
+    slots.reserve(indices.size());
+    for (size_t index : indices) {
+      if (is_live(index))
+        slots.push_back({index, vptr_at(index)});
+    }
+    auto by_index = [](const FreedSlot &a, const FreedSlot &b) {
+      return a.index < b.index;
+    };
+    if (!std::is_sorted(slots.begin(), slots.end(), by_index))
+      std::sort(slots.begin(), slots.end(), by_index);
+    slots.erase(std::unique(slots.begin(), slots.end(),
+                            [](const FreedSlot &a, const FreedSlot &b) {
+                              return a.index == b.index;
+                            }),
+                slots.end());
+
+    destroy_slots(slots);
+    release_slots(slots);
+  }
+
+  // Frees every live element for which pred(Base &) returns true, in one
+  // scan, and returns how many were freed. pred sees every element before
+  // any is destroyed, so if it throws the vector is left unchanged.
+  template <typename Predicate> size_t free_if(Predicate &&pred) {
+    std::vector<FreedSlot> slots = match_in_range(0, size(), pred);
+    destroy_slots(slots);
+    release_slots(slots);
+    return slots.size();
+  }
+
+  void free_all() {
+    for (auto &object : *this) {
+      object.~Base();
+      reinterpret_cast<poly_data_t &>(object) =
+          free_space; // Zeroed the vtable-pointer
+    }
+
+    m_buffer.clear();
+    m_offsets.resize(
+        1); // We always need the first element for insertion to work
+    m_offsets.back() = 0;
+    m_slot_words.clear();
+    m_occupancy.clear();
+    clear_free_lists();
+    clear_type_indices();
+    expire_handles();
+    m_live_bytes = 0;
+    m_compact_order.clear();
+    m_compact_index = not_compacting;
+  }
+
+  // An evil function that goes against the philisophy of the class. A
+  // PolyVector should never shrink, no element should ever be moved or
+  // destroyed. PolyVector should only be able to grow or be cleared.
+  // void erase_back() {
+  //   if (size() <= 1)
+  //     return;
+  //   m_buffer.erase(m_buffer.begin() +
+  //                      static_cast<std::ptrdiff_t>((m_offsets.back() - 1)),
+  //                  m_buffer.end());
+  //   m_offsets.pop_back();
+  // }
+
+  void shrink_to_fit() noexcept {
+    m_offsets.shrink_to_fit();
+    m_slot_words.shrink_to_fit();
+    m_occupancy.shrink_to_fit();
+    if constexpr (!Storage::stable_addresses) {
+      if (m_relocated_types != 0) {
+        // Only a request, like std::vector's: the buffer stays as it is if
+        // a smaller one cannot be allocated
+        try {
+          if (m_buffer.capacity() > m_buffer.size())
+            reallocate_buffer(m_buffer.size());
+        } catch (const std::bad_alloc &) {
+        }
+        return;
+      }
+    }
+    m_buffer.shrink_to_fit();
+  }
+
+  // Slides live objects towards the front of the buffer so freed slots take
+  // no space and are dropped from reuse, and shrinks each slot to its
+  // object. Indices keep referring to the same objects, but the objects
+  // move, so pointers into the vector are invalidated.
+  void compact() { compact_step(SIZE_MAX); }
+
+  // Incremental compact(): moves objects until at least byte_budget bytes
+  // have been moved and returns true once the whole vector is compacted.
+  // Until then emplace() and push() append instead of reusing free space.
+  // Objects move in buffer order, so none passes over one that has not
+  // moved yet, and the objects appended meanwhile go last.
+  bool compact_step(size_t byte_budget) {
+    if (!compacting())
+      start_compaction();
+
+    size_t moved = 0;
+    std::vector<poly_data_t,
+                AlignedAllocator<poly_data_t, Storage::max_alignment,
+                                 rebind_alloc_t<Allocator, poly_data_t>>>
+        scratch(m_occupancy.get_allocator());
+    size_t ordered = m_compact_order.size();
+    while (m_compact_index < ordered + size() - m_compact_end &&
+           moved < byte_budget) {
+      size_t at = m_compact_index++;
+      size_t index = (at < ordered) ? size_t(m_compact_order[at])
+                                    : m_compact_end + at - ordered;
+      if (!is_live(index))
+        continue;
+
+      // The slot shrinks to its object, which drops padding for a minimum
+      // alignment lowered since the object was placed. One raised since may
+      // ask for more room than is left before the object, and an object
+      // that would move towards the end stays put, so no object is written
+      // over one that has not moved yet.
+      size_t start = m_offsets[index];
+      const TypeRecord *type = find_type(vptr_at(index));
+      size_t words = m_slot_words[index];
+      if (type != nullptr)
+        words = std::min(words, placed_words(type->size));
+      size_t target = std::min(
+          start, Storage::place(align(m_compact_cursor,
+                                      compact_alignment(type)),
+                                words));
+      relocate_fn relocate = type ? type->relocate : nullptr;
+      if (target != start) {
+        if (relocate == nullptr) {
+          std::memmove(&m_buffer[target], &m_buffer[start],
+                       words << poly_data_byte_scale);
+        } else if (target + words > start) {
+          // A move constructor cannot run into memory overlapping its
+          // source, so the object passes through scratch space
+          scratch.resize(std::max(scratch.size(), poly_data_words(type->size)));
+          relocate(scratch.data(), &m_buffer[start]);
+          relocate(&m_buffer[target], scratch.data());
+        } else {
+          relocate(&m_buffer[target], &m_buffer[start]);
+        }
+        moved += words << poly_data_byte_scale;
+        m_offsets[index] = static_cast<buffer_offset_t>(target);
+      }
+      m_slot_words[index] = static_cast<buffer_offset_t>(words);
+      m_compact_cursor = target + words;
+    }
+
+    if (m_compact_index < ordered + size() - m_compact_end)
+      return false;
+
+    m_offsets.back() = static_cast<buffer_offset_t>(m_compact_cursor);
+    m_buffer.resize(m_compact_cursor); // Never grows
+    m_compact_order.clear();
+    m_compact_index = not_compacting;
+    rebuild_free_lists();
+    return true;
+  }
+
+  bool compacting() const noexcept { return m_compact_index != not_compacting; }
+
+  static constexpr size_t free_histogram_buckets = 16;
+
+  struct Stats {
+    size_t buffer_bytes;      // Up to the end of the last object
+    size_t live_bytes;        // sizeof() of every live object
+    size_t free_bytes;        // Free regions: freed slots and alignment gaps
+    size_t padding_bytes;     // Rounding objects up to their slots
+    size_t free_slots;        // Freed indices no insert has taken yet
+    size_t largest_free_slot; // Largest free region, in bytes
+    // Bucket b counts free regions of [2^b, 2^(b+1)) poly_data_t units, the
+    // last bucket everything larger
+    std::array<size_t, free_histogram_buckets> free_slot_histogram;
+  };
+
+  // O(1) apart from one lookup per alignment class: every figure is kept up
+  // to date by the insert and free paths. An unfinished compact_step() has
+  // no free regions, the space it has yet to reclaim counts as padding.
+  Stats stats() const noexcept {
+    size_t buffer_bytes = m_offsets.back() << poly_data_byte_scale;
+    size_t largest = 0;
+    for (uint32_t classes = m_free_classes; classes != 0;
+         classes &= classes - 1) {
+      size_t c = static_cast<size_t>(std::countr_zero(classes));
+      largest = std::max<size_t>(largest, m_free_lists[c].rbegin()->first);
+    }
+
+    return {buffer_bytes,
+            m_live_bytes,
+            m_free_bytes,
+            buffer_bytes - m_live_bytes - m_free_bytes,
+            m_free_count,
+            largest << poly_data_byte_scale,
+            m_free_histogram};
+  }
+
+  void reserve_buffer(size_t bytes) {
+    size_t words = poly_data_words(bytes);
+    if constexpr (!Storage::stable_addresses) {
+      if (words > m_buffer.capacity() && m_relocated_types != 0) {
+        reallocate_buffer(words);
+        return;
+      }
+    }
+    m_buffer.reserve(words);
+  }
+
+  void reserve_elements(size_t n) {
+    m_offsets.reserve(n);
+    m_slot_words.reserve(n);
+    m_occupancy.reserve((n + 63) >> 6);
+  }
+
+  // Places every element inserted from now on at a multiple of bytes and
+  // pads its slot to one, so elements never share a line of that size.
+  // set_min_alignment(cache_line_size) keeps threads that write
+  // neighbouring elements from false sharing. bytes must be a power of two
+  // no larger than Storage::max_alignment.
+  void set_min_alignment(size_t bytes) {
+    if (!std::has_single_bit(bytes) || bytes > Storage::max_alignment) {
+      throw std::invalid_argument(
+          "somm::PolyVector::set_min_alignment(): " + std::to_string(bytes) +
+          " is not a power of two up to " +
+          std::to_string(Storage::max_alignment));
+    }
+    m_min_alignment = std::max(bytes, sizeof(poly_data_t));
+  }
+
+  size_t min_alignment() const noexcept { return m_min_alignment; }
+
+  template <typename Derived> size_t push_back(const Derived &object) noexcept {
+    assert_insertable<Derived>();
+    return track_type<Derived>(buffer_write_back(
+        [&](size_t start) {
+          new (&m_buffer[start]) Derived(
+              object); /* Does not work if copy constructor is deleted */
+        },
+        sizeof(Derived), alignof(Derived)));
+  }
+
+  template <typename Derived> size_t push(const Derived &object) noexcept {
+    assert_insertable<Derived>();
+    return track_type<Derived>(buffer_write(
+        [&](size_t start) {
+          new (&m_buffer[start]) Derived(
+              object); /* Does not work if copy constructor is deleted */
+        },
+        sizeof(Derived), alignof(Derived)));
+  }
+
+  template <typename Derived, typename... Args>
+  size_t emplace_back(Args &&...args) noexcept {
+    assert_insertable<Derived>();
+    return track_type<Derived>(buffer_write_back(
+        [&](size_t start) {
+          new (&m_buffer[start]) Derived(std::forward<Args>(args)...);
+        },
+        sizeof(Derived), alignof(Derived)));
+  }
+
+  template <typename Derived, typename... Args>
+  size_t emplace(Args &&...args) noexcept {
+    assert_insertable<Derived>();
+    return track_type<Derived>(buffer_write(
+        [&](size_t start) {
+          new (&m_buffer[start]) Derived(std::forward<Args>(args)...);
+        },
+        sizeof(Derived), alignof(Derived)));
+  }
+
+  // Appends count objects of Derived, each constructed from args, after
+  // growing the buffer, the offset table and the bitmap once. Returns the
+  // first new index, or size() when they do not fit and nothing is added.
+  template <typename Derived, typename... Args>
+  size_t emplace_n(size_t count, const Args &...args) noexcept {
+    assert_insertable<Derived>();
+    return buffer_write_back_n<Derived>(count, [&](size_t start) {
+      new (&m_buffer[start]) Derived(args...);
+    });
+  }
+
+  // Appends a copy of every element of range like emplace_n(), in order
+  template <std::ranges::forward_range Range>
+  size_t append_range(Range &&range) noexcept {
+    using Derived = std::ranges::range_value_t<Range>;
+    assert_insertable<Derived>();
+    auto element = std::ranges::begin(range);
+    return buffer_write_back_n<Derived>(
+        static_cast<size_t>(std::ranges::distance(range)),
+        [&](size_t start) {
+          new (&m_buffer[start]) Derived(*element);
+          ++element;
+        });
+  }
+
+  // Memplace: Memcopies object data into buffer without calling constructor
+
+  size_t memplace_back(const Base &object, size_t size,
+                       size_t alignment) noexcept {
+    return record_type(buffer_write_back(
+        [&](size_t start) {
+          std::memcpy(&m_buffer[start], static_cast<const void *>(&object),
+                      size);
+        },
+        size, alignment),
+        &typeid(object), size, alignment, nullptr, nullptr);
+  }
+
+  size_t memplace(const Base &object, size_t size, size_t alignment) noexcept {
+    return record_type(buffer_write(
+        [&](size_t start) {
+          std::memcpy(&m_buffer[start], static_cast<const void *>(&object),
+                      size);
+        },
+        size, alignment),
+        &typeid(object), size, alignment, nullptr, nullptr);
+  }
+
+  // Calls fn(Base &) on every live element in index order
+  template <typename Function> void for_each(Function &&fn) {
+    for (size_t index = next_live(0); index < size();
+         index = next_live(index + 1)) {
+      fn(object_at(index));
+    }
+  }
+
+  // Calls fn(Base &) on every live element with an index in [first, last)
+  template <typename Function>
+  void for_each_in_range(size_t first, size_t last, Function &&fn) {
+    last = std::min(last, size());
+    for (size_t index = next_live(first); index < last;
+         index = next_live(index + 1)) {
+      fn(object_at(index));
+    }
+  }
+
+  // Splits the indices into up to count ranges covering about the same number
+  // of buffer bytes. Range i is [bounds[i], bounds[i + 1]), starting at the
+  // first index whose slot sizes before it add up to its share of the slots.
+  // A reused index may sit anywhere in the buffer, so this sums the slot
+  // sizes in index order rather than searching the offsets.
+  std::vector<size_t> byte_balanced_bounds(size_t count) const {
+    count = std::clamp<size_t>(count, 1, std::max<size_t>(size(), 1));
+    size_t total = 0;
+    for (size_t index = 0; index < size(); ++index)
+      total += m_slot_words[index];
+    size_t share = total / count;
+
+    std::vector<size_t> bounds(count + 1, size());
+    bounds[0] = 0;
+    size_t range = 1;
+    size_t covered = 0;
+    for (size_t index = 0; index < size() && range < count; ++index) {
+      while (range < count && covered >= share * range)
+        bounds[range++] = index;
+      covered += m_slot_words[index];
+    }
+    return bounds;
+  }
+
+  // Closed type list: fn is called with Derived & for elements whose dynamic
+  // type is one of Derived..., and with Base & for every other element. The
+  // type is resolved once per run of elements sharing a vtable pointer, so a
+  // homogeneous region runs as a loop over a statically known type (declare
+  // the methods final to let the compiler inline them).
+  template <typename... Derived, typename Function>
+    requires(sizeof...(Derived) > 0)
+  void for_each(Function &&fn) {
+    (assert_must_derive<Base, Derived>(), ...);
+    size_t index = next_live(0);
+    while (index < size()) {
+      const std::type_info &type = typeid(object_at(index));
+      poly_data_t vptr = vptr_at(index);
+      bool resolved =
+          ((type == typeid(Derived) &&
+            (index = for_each_run<Derived>(fn, index, vptr), true)) ||
+           ...);
+      if (!resolved)
+        index = for_each_run<Base>(fn, index, vptr);
+    }
+  }
+
+  // Calls (object.*method)(args...) on every live element. The virtual call
+  // is resolved once per run of elements sharing a vtable pointer and the run
+  // is dispatched through that single target.
+  template <typename Ret, typename... Params, typename... Args>
+  void invoke_all(Ret (Base::*method)(Params...), Args &&...args) {
+    invoke_runs<Ret, Params...>(method, args...);
+  }
+
+  template <typename Ret, typename... Params, typename... Args>
+  void invoke_all(Ret (Base::*method)(Params...) const, Args &&...args) {
+    invoke_runs<Ret, Params...>(method, args...);
+  }
+
+  // The live elements whose dynamic type is exactly Derived, in index order,
+  // read through the type's own bitmap without a cast or a virtual call.
+  // Inserting or freeing an element of Derived invalidates the view.
+  template <typename Derived> class TypeView {
+  public:
+    struct Iterator {
+      using iterator_category = std::forward_iterator_tag;
+      using value_type = Derived;
+      using difference_type = std::ptrdiff_t;
+      using pointer = Derived *;
+      using reference = Derived &;
+
+      Iterator() = default;
+
+      Iterator(PolyVector *vector, const occupancy_word_t *bits, size_t words,
+               size_t index)
+          : poly_vec(vector), m_bits(bits), m_words(words),
+            m_index(next_set_bit(bits, words, index, words << 6)) {
+        load_word();
+      }
+
+      pointer operator->() const { return &**this; }
+
+      reference operator*() const {
+        return *reinterpret_cast<Derived *>(
+            &poly_vec->m_buffer[poly_vec->m_offsets[m_index]]);
+      }
+
+      Iterator &operator++() {
+        if (m_word != 0) {
+          m_index = (m_index & ~size_t(63)) +
+                    static_cast<size_t>(std::countr_zero(m_word));
+          m_word &= m_word - 1;
+        } else {
+          m_index = next_set_bit(m_bits, m_words, (m_index | 63) + 1,
+                                 m_words << 6);
+          load_word();
+        }
+        return *this;
+      }
+
+      Iterator operator++(int) {
+        Iterator temp = *this;
+        ++(*this);
+        return temp;
+      }
+
+      bool operator==(const Iterator &other) const {
+        return m_index == other.m_index;
+      }
+
+      bool operator!=(const Iterator &other) const {
+        return !(*this == other);
+      }
+
+    private:
+      // The bits of m_index's word above m_index
+      void load_word() noexcept {
+        m_word = (m_index < (m_words << 6))
+                     ? m_bits[m_index >> 6] &
+                           ~((occupancy_word_t(2) << (m_index & 63)) - 1)
+                     : 0;
+      }
+
+      PolyVector *poly_vec = nullptr;
+      const occupancy_word_t *m_bits = nullptr;
+      size_t m_words = 0;
+      size_t m_index = 0;
+      occupancy_word_t m_word = 0;
+    };
+
+    Iterator begin() const { return {m_vector, m_bits, m_words, 0}; }
+
+    Iterator end() const {
+      return {m_vector, m_bits, m_words, m_words << 6};
+    }
+
+    size_t size() const noexcept { return m_count; }
+
+    bool empty() const noexcept { return m_count == 0; }
+
+  private:
+    friend class PolyVector;
+
+    TypeView(PolyVector *vector, const occupancy_word_t *bits, size_t words,
+             size_t count) noexcept
+        : m_vector(vector), m_bits(bits), m_words(words), m_count(count) {}
+
+    PolyVector *m_vector;
+    const occupancy_word_t *m_bits;
+    size_t m_words;
+    size_t m_count;
+  };
+
+  template <typename Derived> TypeView<Derived> view() noexcept {
+    assert_must_derive<Base, Derived>();
+    for (auto &type : m_types) {
+      if (*type.type == typeid(Derived))
+        return {this, type.live.data(), type.live.size(), type.count};
+    }
+    return {this, nullptr, 0, 0};
+  }
+
+  class ConcurrentAppender;
+
+  // Reserves room for elements more objects in bytes more buffer space and
+  // returns an appender that several threads may emplace_back() through at
+  // once. The vector must not be used in any other way until the appender is
+  // destroyed or finish()ed.
+  ConcurrentAppender concurrent_appender(size_t bytes, size_t elements) {
+    return ConcurrentAppender(*this, poly_data_words(bytes), elements);
+  }
+
+  // Moves every live object into a FrozenPolyVector and leaves this vector
+  // empty. Objects are packed at their type's alignment, ignoring
+  // set_min_alignment() since nothing writes to a frozen vector, and freed
+  // indices become empty slots so indices still name the same objects.
+  // read_only also maps the frozen memory PROT_READ where mprotect() is
+  // available.
+  FrozenPolyVector<Base, Offset> freeze(bool read_only = false) && {
+    if (compacting())
+      compact();
+
+    // Calls place(index, start, type) for every index of the packed layout,
+    // with a null type for freed indices, and returns its size in words
+    auto lay_out = [this](auto &&place) {
+      size_t cursor = 0;
+      poly_data_t vptr = 0;
+      const TypeRecord *type = nullptr;
+      for (size_t index = 0; index < size(); ++index) {
+        if (!is_live(index)) {
+          place(index, cursor, nullptr);
+          continue;
+        }
+        if (type == nullptr || vptr_at(index) != vptr) {
+          vptr = vptr_at(index);
+          type = find_type(vptr);
+        }
+        size_t start = align(cursor, poly_data_words(type->alignment));
+        place(index, start, type);
+        cursor = start + poly_data_words(type->size);
+      }
+      return cursor;
+    };
+
+    FrozenPolyVector<Base, Offset> frozen(
+        size(), lay_out([](size_t, size_t, const TypeRecord *) {}));
+    size_t words = lay_out([&](size_t index, size_t start,
+                               const TypeRecord *type) {
+      frozen.m_offsets[index] = static_cast<Offset>(start);
+      if (type == nullptr)
+        return;
+      void *src = &m_buffer[m_offsets[index]];
+      if (type->relocate)
+        type->relocate(&frozen.m_buffer[start], src);
+      else
+        std::memcpy(&frozen.m_buffer[start], src, type->size);
+    });
+    frozen.m_offsets[size()] = static_cast<Offset>(words);
+    std::copy(m_occupancy.begin(), m_occupancy.end(), frozen.m_occupancy);
+    frozen.build_ranks();
+
+    clear(); // The objects now live in frozen
+    if (read_only)
+      frozen.protect();
+    return frozen;
+  }
+
+  // Writes the vector to path as one image: a header, a table of the types
+  // it holds, the offset and slot size tables, the occupancy bitmap and the
+  // buffer, with
+  // every live object's vtable pointer replaced by its ID in registry. The
+  // image is only readable by the same architecture and Offset type.
+  void save(const std::string &path, const TypeRegistry<Base> &registry) const {
+    if (compacting())
+      throw std::logic_error("somm::PolyVector::save(): compaction pending");
+
+    std::vector<ImageType> table;
+    std::vector<std::pair<poly_data_t, poly_data_t>> ids; // vptr -> ID
+    for (auto &type : m_types) {
+      if (type.count == 0)
+        continue;
+      const auto *entry = registry.find(*type.type);
+      if (entry == nullptr) {
+        throw std::invalid_argument("somm::PolyVector::save(): type " +
+                                    std::string(type.type->name()) +
+                                    " is not registered");
+      }
+      table.push_back({entry->id, static_cast<uint32_t>(entry->alignment),
+                       entry->size});
+      ids.emplace_back(type.vptr, entry->id);
+    }
+
+    std::unique_ptr<FILE, decltype(&std::fclose)> file(
+        std::fopen(path.c_str(), "wb"), &std::fclose);
+    if (!file)
+      throw std::runtime_error("somm::PolyVector::save(): cannot open " + path);
+    auto write = [&](const void *data, size_t bytes) {
+      if (bytes != 0 && std::fwrite(data, bytes, 1, file.get()) != 1)
+        throw std::runtime_error("somm::PolyVector::save(): cannot write " +
+                                 path);
+    };
+
+    size_t buffer_words = m_offsets.back();
+    ImageHeader header = {image_magic,      sizeof(poly_data_t),
+                          sizeof(Offset),   size(),
+                          m_occupancy.size(), buffer_words,
+                          table.size()};
+    write(&header, sizeof(header));
+    write(table.data(), table.size() * sizeof(ImageType));
+    write(m_offsets.data(), (size() + 1) * sizeof(buffer_offset_t));
+    write(m_slot_words.data(), size() * sizeof(buffer_offset_t));
+    write(m_occupancy.data(), m_occupancy.size() * sizeof(occupancy_word_t));
+
+    // The buffer goes out in chunks with the vptrs of the objects starting
+    // in each chunk swapped for IDs, visiting the objects in buffer order
+    constexpr size_t chunk_words = 1 << 16;
+    std::vector<poly_data_t> chunk(std::min(buffer_words, chunk_words));
+    indices_t by_start = live_by_start();
+    auto object = by_start.begin();
+    std::pair<poly_data_t, poly_data_t> last = {free_space, 0};
+    for (size_t first = 0; first < buffer_words; first += chunk.size()) {
+      size_t count = std::min(chunk.size(), buffer_words - first);
+      for (size_t word = 0; word < count; ++word) {
+        chunk[word] = m_buffer[first + word];
+      }
+      for (; object != by_start.end() && m_offsets[*object] < first + count;
+           ++object) {
+        poly_data_t &vptr = chunk[m_offsets[*object] - first];
+        if (vptr != last.first)
+          last = *std::find_if(ids.begin(), ids.end(),
+                               [&](auto &id) { return id.first == vptr; });
+        vptr = last.second;
+      }
+      write(chunk.data(), count * sizeof(poly_data_t));
+    }
+
+    if (std::fclose(file.release()) != 0)
+      throw std::runtime_error("somm::PolyVector::save(): cannot write " +
+                               path);
+  }
+
+#ifdef SOMM_HAS_VIRTUAL_STORAGE
+  // Destroys the current elements and restores an image written by save().
+  // The file is mapped and copied into the buffer, then one pass over the
+  // live objects swaps each ID for the vptr registry holds for it. No
+  // constructor runs. Throws std::runtime_error when the image is malformed
+  // or names a type registry does not know or knows with another size or
+  // alignment. A bad header or type table leaves the vector unchanged, any
+  // later error leaves it empty.
+  void load(const std::string &path, const TypeRegistry<Base> &registry) {
+    MappedFile file(path);
+    const std::byte *cursor = file.data();
+    size_t remaining = file.size();
+    // The next count items of size bytes in the image
+    auto take = [&](uint64_t count, size_t size) {
+      if (count > remaining / size)
+        throw std::runtime_error("somm::PolyVector::load(): " + path +
+                                 " is truncated");
+      const std::byte *data = cursor;
+      cursor += count * size;
+      remaining -= static_cast<size_t>(count) * size;
+      return data;
+    };
+
+    ImageHeader header;
+    std::memcpy(&header, take(1, sizeof(header)), sizeof(header));
+    // Every count has to fit in the file before any arithmetic on it
+    if (header.elements > remaining / sizeof(buffer_offset_t) / 2 ||
+        header.buffer_words > remaining / sizeof(poly_data_t) ||
+        header.types > remaining / sizeof(ImageType)) {
+      throw std::runtime_error("somm::PolyVector::load(): " + path +
+                               " is truncated");
+    }
+    if (header.magic != image_magic ||
+        header.word_size != sizeof(poly_data_t) ||
+        header.offset_size != sizeof(Offset) ||
+        header.occupancy_words != (header.elements + 63) >> 6 ||
+        header.buffer_words > max_offset()) {
+      throw std::runtime_error("somm::PolyVector::load(): " + path +
+                               " is not an image this vector can hold");
+    }
+
+    std::vector<std::pair<poly_data_t, const registry_entry_t *>>
+        entries; // ID -> registry entry
+    for (uint64_t i = 0; i < header.types; ++i) {
+      ImageType type;
+      std::memcpy(&type, take(1, sizeof(type)), sizeof(type));
+      const auto *entry = registry.find(type.id);
+      if (entry == nullptr || entry->size != type.size ||
+          entry->alignment != type.alignment ||
+          entry->alignment > Storage::max_alignment) {
+        throw std::runtime_error("somm::PolyVector::load(): type " +
+                                 std::to_string(type.id) + " in " + path +
+                                 " is unknown or has changed");
+      }
+      entries.emplace_back(type.id, entry);
+    }
+
+    free_all();
+    try {
+      const std::byte *offsets =
+          take(header.elements + 1, sizeof(buffer_offset_t));
+      const std::byte *slot_words =
+          take(header.elements, sizeof(buffer_offset_t));
+      const std::byte *occupancy =
+          take(header.occupancy_words, sizeof(occupancy_word_t));
+      const std::byte *buffer = take(header.buffer_words, sizeof(poly_data_t));
+      size_t elements = static_cast<size_t>(header.elements);
+      size_t buffer_words = static_cast<size_t>(header.buffer_words);
+
+      m_offsets.resize(elements + 1);
+      std::memcpy(m_offsets.data(), offsets,
+                  (elements + 1) * sizeof(buffer_offset_t));
+      m_slot_words.resize(elements);
+      if (elements != 0)
+        std::memcpy(m_slot_words.data(), slot_words,
+                    elements * sizeof(buffer_offset_t));
+      m_occupancy.resize(static_cast<size_t>(header.occupancy_words));
+      if (!m_occupancy.empty())
+        std::memcpy(m_occupancy.data(), occupancy,
+                    m_occupancy.size() * sizeof(occupancy_word_t));
+      m_buffer.resize(buffer_words);
+      if constexpr (requires { m_buffer.data(); }) {
+        if (buffer_words != 0)
+          std::memcpy(m_buffer.data(), buffer,
+                      buffer_words * sizeof(poly_data_t));
+      } else {
+        for (size_t word = 0; word < buffer_words; ++word) {
+          std::memcpy(&m_buffer[word], buffer + word * sizeof(poly_data_t),
+                      sizeof(poly_data_t));
+        }
+      }
+
+      if (m_offsets.back() != buffer_words)
+        throw std::runtime_error("somm::PolyVector::load(): " + path +
+                                 " has a buffer of the wrong size");
+      if ((elements & 63) != 0 &&
+          (m_occupancy.back() >> (elements & 63)) != 0)
+        throw std::runtime_error("somm::PolyVector::load(): " + path +
+                                 " marks indices past its size live");
+
+      poly_data_t last_id = free_space;
+      const registry_entry_t *entry = nullptr;
+      TypeRecord *type = nullptr;
+      for (size_t index = 0; index < size(); ++index) {
+        if (!is_live(index))
+          m_slot_words[index] = 0;
+      }
+      for (size_t index = next_live(0); index < size();
+           index = next_live(index + 1)) {
+        size_t start = m_offsets[index];
+        size_t slot = m_slot_words[index];
+        if (slot == 0)
+          throw std::runtime_error("somm::PolyVector::load(): " + path +
+                                   " marks an empty slot live");
+        if (start >= buffer_words || slot > buffer_words - start)
+          throw std::runtime_error("somm::PolyVector::load(): " + path +
+                                   " has a slot past the end of its buffer");
+        poly_data_t id = m_buffer[start];
+        if (entry == nullptr || id != last_id) {
+          auto found =
+              std::find_if(entries.begin(), entries.end(),
+                           [&](auto &known) { return known.first == id; });
+          if (found == entries.end())
+            throw std::runtime_error("somm::PolyVector::load(): " + path +
+                                     " holds an object of unknown type " +
+                                     std::to_string(id));
+          last_id = id;
+          entry = found->second;
+          type = &add_type(entry->vptr, entry->type, entry->size,
+                           entry->alignment, nullptr, nullptr);
+        }
+        size_t words = poly_data_words(entry->size);
+        if (words > slot ||
+            start % poly_data_words(entry->alignment) != 0 ||
+            Storage::place(start, words) != start)
+          throw std::runtime_error("somm::PolyVector::load(): " + path +
+                                   " places an object where this storage "
+                                   "cannot hold it");
+        m_buffer[start] = entry->vptr;
+        mark_type(*type, index, index + 1);
+        m_live_bytes += entry->size;
+      }
+
+      size_t end = 0;
+      for (size_t index : live_by_start()) {
+        if (m_offsets[index] < end)
+          throw std::runtime_error("somm::PolyVector::load(): " + path +
+                                   " has overlapping slots");
+        end = m_offsets[index] + m_slot_words[index];
+      }
+    } catch (...) {
+      clear();
+      throw;
+    }
+    rebuild_free_lists();
+  }
+#endif
+
+private:
+  template <typename, typename...> friend class ClosedPolyVector;
+  // The parallel free_if() in poly_vector_execution.h runs the phases of
+  // free_if() itself
+  template <typename ExecutionPolicy, typename B, typename S, typename A,
+            typename O, typename Predicate>
+  friend size_t free_if(ExecutionPolicy &&policy,
+                        PolyVector<B, S, A, O> &vector, Predicate &&pred);
+
+  static constexpr poly_data_t free_space = 0;
+  static constexpr size_t not_compacting = SIZE_MAX;
+  static constexpr uint64_t image_magic = 0x32305650'4d4d4f53; // "SOMMPV02"
+
+  // save() image layout: the header, a table of header.types entries, then
+  // the offset table, the slot size of each index, the occupancy bitmap and
+  // the buffer
+  struct ImageHeader {
+    uint64_t magic;
+    uint32_t word_size;
+    uint32_t offset_size;
+    uint64_t elements;
+    uint64_t occupancy_words;
+    uint64_t buffer_words;
+    uint64_t types;
+  };
+
+  struct ImageType {
+    uint32_t id;
+    uint32_t alignment;
+    uint64_t size;
+  };
+
+  using registry_entry_t = typename TypeRegistry<Base>::Entry;
+
+  using allocator_traits = std::allocator_traits<Allocator>;
+  using buffer_t = typename Storage::template buffer_type<Allocator>;
+  using offsets_t =
+      typename Storage::template offsets_type<Allocator, buffer_offset_t>;
+  using occupancy_t = std::vector<occupancy_word_t,
+                                  rebind_alloc_t<Allocator, occupancy_word_t>>;
+  using indices_t =
+      std::vector<free_index_t, rebind_alloc_t<Allocator, free_index_t>>;
+  using generations_t =
+      std::vector<generation_t, rebind_alloc_t<Allocator, generation_t>>;
+
+  // Free space is kept as regions of the buffer, maximal runs of words that
+  // no live slot covers. Each region is listed by start, which finds the
+  // regions to merge a freed slot with in O(log n), and in the bucket of
+  // the alignment class of its start (log2 in poly_data_t units, capped),
+  // ordered by size for best fit. A region of class c can host any
+  // alignment of class <= c. A region made by freeing a slot is owned by
+  // the freed index, so the next insert into it reuses the index in place.
+  static constexpr size_t free_align_classes = 13;
+  static constexpr free_index_t no_owner =
+      std::numeric_limits<free_index_t>::max();
+
+  struct FreeRegion {
+    buffer_offset_t words;
+    free_index_t owner; // A free index, or no_owner
+  };
+
+  using free_region_map_t =
+      std::map<buffer_offset_t, FreeRegion, std::less<buffer_offset_t>,
+               rebind_alloc_t<Allocator,
+                              std::pair<const buffer_offset_t, FreeRegion>>>;
+  using free_bucket_entry_t = std::pair<buffer_offset_t, buffer_offset_t>;
+  using free_bucket_t =
+      std::set<free_bucket_entry_t, std::less<free_bucket_entry_t>,
+               rebind_alloc_t<Allocator, free_bucket_entry_t>>;
+  using free_lists_t = std::array<free_bucket_t, free_align_classes>;
+
+  static free_lists_t make_free_lists(const Allocator &alloc) {
+    return [&]<size_t... Class>(std::index_sequence<Class...>) {
+      return free_lists_t{((void)Class, free_bucket_t(alloc))...};
+    }(std::make_index_sequence<free_align_classes>());
+  }
+
+  template <typename WriterFunction>
+  size_t buffer_write_back(WriterFunction &&write, size_t size,
+                           size_t alignment) noexcept {
+    if (alignment > Storage::max_alignment)
+      return this->size();
+    size_t words = placed_words(size);
+    size_t start = append_space(words, placed_alignment(alignment));
+    if (start == SIZE_MAX)
+      return this->size();
+
+    write(start);
+    size_t index = push_index();
+    take_slot(index, start, words);
+    m_offsets.back() = static_cast<buffer_offset_t>(start + words);
+    set_live(index);
+    return index;
+  }
+
+  // buffer_write_back() for count objects of Derived: the offsets are laid
+  // out in one pass, then the buffer and the bitmap grow once and the
+  // objects are constructed in index order
+  template <typename Derived, typename WriterFunction>
+  size_t buffer_write_back_n(size_t count, WriterFunction &&write) noexcept {
+    size_t first = this->size();
+    size_t words = placed_words(sizeof(Derived));
+    size_t alignment = placed_alignment(alignof(Derived));
+    if (count == 0 || words > Storage::max_object_words)
+      return first;
+
+    size_t limit = max_offset();
+    buffer_offset_t back = m_offsets.back();
+    size_t cursor = back;
+    m_offsets.resize(first + count + 1);
+    for (size_t index = first; index < first + count; ++index) {
+      size_t start = Storage::place(align(cursor, alignment), words);
+      if (start < cursor || start + words > limit) {
+        m_offsets.resize(first + 1);
+        m_offsets.back() = back;
+        return first;
+      }
+      m_offsets[index] = static_cast<buffer_offset_t>(start);
+      cursor = start + words;
+    }
+    m_offsets.back() = static_cast<buffer_offset_t>(cursor);
+    m_slot_words.resize(first + count);
+    std::fill_n(&m_slot_words[first], count,
+                static_cast<buffer_offset_t>(words));
+    list_append_gaps(first, back);
+
+    grow_buffer(cursor);
+    m_occupancy.resize((first + count + 63) >> 6);
+    for (size_t index = first; index < first + count; ++index) {
+      write(m_offsets[index]);
+    }
+    set_live_range(first, first + count);
+
+    TypeRecord &type = add_type(vptr_at(first), &typeid(Derived),
+                                sizeof(Derived), alignof(Derived),
+                                relocator_of<Derived>(),
+                                &copy_object<Derived>);
+    mark_type(type, first, first + count);
+    m_live_bytes += count * sizeof(Derived);
+    return first;
+  }
+
+  // Reuses free space and free indices before growing either: the best
+  // fitting region takes the object, in the region's own index when it has
+  // one, and what the object leaves of the region stays free. Without a
+  // fitting region the object is appended, still in a free index if any.
+  template <typename WriterFunction>
+  size_t buffer_write(WriterFunction &&write, size_t size,
+                      size_t alignment) noexcept {
+    if (compacting())
+      return buffer_write_back(write, size, alignment);
+
+    if (alignment > Storage::max_alignment)
+      return this->size();
+    size_t words = placed_words(size);
+    auto region =
+        best_free_region(words, align_class(placed_alignment(alignment)));
+    if (region != m_free_regions.end()) {
+      // A merged region may span a boundary the storage cannot place an
+      // object across. The skipped head stays free.
+      size_t first = region->first;
+      size_t last = first + region->second.words;
+      size_t start = Storage::place(first, words);
+      if (start + words <= last) {
+        size_t index = region->second.owner;
+        unlist_region(region);
+        if (start != first)
+          list_region(first, start - first, no_owner);
+        if (start + words != last)
+          list_region(start + words, last - start - words, no_owner);
+
+        write(start);
+        if (index == no_owner)
+          index = m_free_indices.empty() ? push_index() : pop_free_index();
+        else
+          --m_free_count;
+        take_slot(index, start, words);
+        set_live(index);
+        return index;
+      }
+    }
+
+    if (m_free_indices.empty())
+      return buffer_write_back(write, size, alignment);
+    size_t start = append_space(words, placed_alignment(alignment));
+    if (start == SIZE_MAX)
+      return this->size();
+
+    write(start);
+    size_t index = pop_free_index();
+    take_slot(index, start, words);
+    m_offsets.back() = static_cast<buffer_offset_t>(start + words);
+    set_live(index);
+    return index;
+  }
+
+  // Makes room for words at the end of the buffer and returns their start,
+  // or SIZE_MAX when the buffer or the offset type cannot hold them. The
+  // alignment gap before them becomes a free region, and the caller moves
+  // the end of the buffer past them.
+  size_t append_space(size_t words, size_t alignment) noexcept {
+    if (words > Storage::max_object_words)
+      return SIZE_MAX;
+    size_t cursor = m_offsets.back();
+    size_t start = Storage::place(align(cursor, alignment), words);
+    size_t end = start + words;
+    if (start > end || end > max_offset())
+      return SIZE_MAX;
+
+    grow_buffer(end);
+    if (start != cursor && !compacting())
+      list_region(cursor, start - cursor, no_owner);
+    return start;
+  }
+
+  // A new index past the last one, with an empty slot
+  size_t push_index() noexcept {
+    size_t index = size();
+    m_offsets.emplace_back(m_offsets.back());
+    m_slot_words.emplace_back(0);
+    if ((index & 63) == 0)
+      m_occupancy.emplace_back(0);
+    return index;
+  }
+
+  size_t pop_free_index() noexcept {
+    size_t index = m_free_indices.back();
+    m_free_indices.pop_back();
+    --m_free_count;
+    return index;
+  }
+
+  void take_slot(size_t index, size_t start, size_t words) noexcept {
+    m_offsets[index] = static_cast<buffer_offset_t>(start);
+    m_slot_words[index] = static_cast<buffer_offset_t>(words);
+  }
+
+  // Lists the alignment and page gaps between the slots appended from index
+  // first on, the first of which was placed past end
+  void list_append_gaps(size_t first, size_t end) {
+    if (compacting())
+      return;
+    for (size_t index = first; index < size(); ++index) {
+      if (m_offsets[index] != end)
+        list_region(end, m_offsets[index] - end, no_owner);
+      end = m_offsets[index] + m_slot_words[index];
+    }
+  }
+
+  template <typename Derived> static constexpr void assert_insertable() {
+    assert_must_derive<Base, Derived>();
+    static_assert(alignof(Derived) <= Storage::max_alignment,
+                  "Type is aligned beyond what the storage guarantees");
+  }
+
+  // An object's slot in poly_data_t units, padded to the minimum alignment
+  size_t placed_words(size_t size) const noexcept {
+    return align(poly_data_words(size), poly_data_words(m_min_alignment));
+  }
+
+  // An object's alignment in poly_data_t units, raised to the minimum
+  // alignment
+  size_t placed_alignment(size_t alignment) const noexcept {
+    return poly_data_words(std::max(alignment, m_min_alignment));
+  }
+
+  // Moves the object at src into the raw storage at dst and ends the
+  // lifetime of the source
+  using relocate_fn = void (*)(void *dst, void *src) noexcept;
+
+  template <typename Derived>
+  static void relocate_object(void *dst, void *src) noexcept {
+    auto *object = static_cast<Derived *>(src);
+    new (dst) Derived(std::move(*object));
+    object->~Derived();
+  }
+
+  // Copy-constructs the object at src into the raw storage at dst
+  using copy_fn = void (*)(void *dst, const void *src);
+
+  template <typename Derived>
+  static void copy_object(void *dst, const void *src) {
+    if constexpr (std::is_copy_constructible_v<Derived>) {
+      new (dst) Derived(*static_cast<const Derived *>(src));
+    } else {
+      throw std::invalid_argument(
+          std::string("somm::PolyVector: cannot copy an object of type ") +
+          typeid(Derived).name() + ", it is not copy constructible");
+    }
+  }
+
+  // What the vector knows about each dynamic type it holds, keyed by vtable
+  // pointer: the object size for stats(), how to relocate it and which
+  // indices hold that type, for view(). A bitmap keeps inserting and
+  // freeing O(1) and is walked like the occupancy bitmap. The record is
+  // allocator-aware so the bitmap follows m_types into a scoped or
+  // polymorphic allocator's memory.
+  struct TypeRecord {
+    using allocator_type = typename occupancy_t::allocator_type;
+
+    TypeRecord(poly_data_t vptr, const std::type_info *type, size_t size,
+               size_t alignment, relocate_fn relocate, copy_fn copy,
+               const allocator_type &alloc)
+        : vptr(vptr), type(type), size(size), alignment(alignment),
+          relocate(relocate), copy(copy), live(alloc) {}
+    TypeRecord(const TypeRecord &) = default;
+    TypeRecord(TypeRecord &&) noexcept = default;
+    TypeRecord(const TypeRecord &other, const allocator_type &alloc)
+        : vptr(other.vptr), type(other.type), size(other.size),
+          alignment(other.alignment), relocate(other.relocate),
+          copy(other.copy), live(other.live, alloc), count(other.count) {}
+    TypeRecord(TypeRecord &&other, const allocator_type &alloc)
+        : TypeRecord(other, alloc) {}
+    TypeRecord &operator=(const TypeRecord &) = default;
+    TypeRecord &operator=(TypeRecord &&) noexcept = default;
+
+    poly_data_t vptr;
+    const std::type_info *type;
+    size_t size;
+    size_t alignment;
+    relocate_fn relocate; // nullptr when memcpy is enough
+    copy_fn copy;         // nullptr for memplace() and load() types
+    occupancy_t live;     // Up to the word of the last index
+    size_t count = 0;     // Bits set in live
+  };
+
+  using types_t =
+      std::vector<TypeRecord, rebind_alloc_t<Allocator, TypeRecord>>;
+
+  // Types without a move or copy constructor keep being moved bitwise. A
+  // throwing move constructor terminates, like every other insert path.
+  template <typename Derived> static constexpr relocate_fn relocator_of() {
+    if constexpr (!is_trivially_relocatable_v<Derived> &&
+                  std::is_move_constructible_v<Derived>)
+      return &relocate_object<Derived>;
+    else
+      return nullptr;
+  }
+
+  template <typename Derived> size_t track_type(size_t index) {
+    return record_type(index, &typeid(Derived), sizeof(Derived),
+                       alignof(Derived), relocator_of<Derived>(),
+                       &copy_object<Derived>);
+  }
+
+  size_t record_type(size_t index, const std::type_info *type, size_t size,
+                     size_t alignment, relocate_fn relocate, copy_fn copy) {
+    if (index >= this->size())
+      return index;
+    m_live_bytes += size;
+    mark_type(add_type(vptr_at(index), type, size, alignment, relocate, copy),
+              index, index + 1);
+    return index;
+  }
+
+  TypeRecord &add_type(poly_data_t vptr, const std::type_info *type,
+                       size_t size, size_t alignment, relocate_fn relocate,
+                       copy_fn copy) {
+    if (TypeRecord *known = find_type(vptr))
+      return *known;
+    m_types.push_back(TypeRecord(vptr, type, size, alignment, relocate, copy,
+                                 m_occupancy.get_allocator()));
+    if (relocate != nullptr)
+      ++m_relocated_types;
+    return m_types.back();
+  }
+
+  // The number of distinct types is small, so a linear scan beats hashing
+  TypeRecord *find_type(poly_data_t vptr) noexcept {
+    for (auto &type : m_types) {
+      if (type.vptr == vptr)
+        return &type;
+    }
+    return nullptr;
+  }
+
+  const TypeRecord *find_type(poly_data_t vptr) const noexcept {
+    return const_cast<PolyVector *>(this)->find_type(vptr);
+  }
+
+  // Records that the indices [first, last) hold type, growing its bitmap
+  // to the word of last - 1
+  static void mark_type(TypeRecord &type, size_t first, size_t last) {
+    if (type.live.size() < ((last + 63) >> 6))
+      type.live.resize((last + 63) >> 6);
+    set_bit_range(type.live.data(), first, last);
+    type.count += last - first;
+  }
+
+  static void unmark_type(TypeRecord &type, size_t index) noexcept {
+    type.live[index >> 6] &= ~(occupancy_word_t(1) << (index & 63));
+    --type.count;
+  }
+
+  // Indices restart from 0 after clear() and free_all(), so every slot that
+  // ever had a handle moves to a new generation. The table keeps its size.
+  void expire_handles() noexcept {
+    for (auto &generation : m_generations) {
+      ++generation;
+    }
+  }
+
+  void clear_type_indices() noexcept {
+    for (auto &type : m_types) {
+      type.live.clear();
+      type.count = 0;
+    }
+  }
+
+  relocate_fn relocator(poly_data_t vptr) const noexcept {
+    const TypeRecord *type = find_type(vptr);
+    return type ? type->relocate : nullptr;
+  }
+
+  // Resizes the buffer to words. When that reallocates a contiguous buffer
+  // holding objects that are not trivially relocatable, the objects are
+  // relocated as by reallocate_buffer().
+  void grow_buffer(size_t words) {
+    if constexpr (!Storage::stable_addresses) {
+      if (words > m_buffer.capacity() && m_relocated_types != 0)
+        reallocate_buffer(std::max(words, m_buffer.capacity() * 2));
+    }
+    m_buffer.resize(words);
+  }
+
+  // Moves a contiguous buffer to a new allocation of capacity words: the
+  // buffer is copied bitwise and only the objects that are not trivially
+  // relocatable are then move-constructed over their copy
+  void reallocate_buffer(size_t capacity) {
+    buffer_t moved(m_buffer.get_allocator());
+    moved.reserve(capacity);
+    moved.resize(m_buffer.size());
+    if (!m_buffer.empty())
+      std::memcpy(moved.data(), m_buffer.data(),
+                  m_buffer.size() << poly_data_byte_scale);
+
+    poly_data_t run_vptr = free_space;
+    relocate_fn relocate = nullptr;
+    for (size_t index = next_live(0); index < size();
+         index = next_live(index + 1)) {
+      if (vptr_at(index) != run_vptr) {
+        run_vptr = vptr_at(index);
+        relocate = relocator(run_vptr);
+      }
+      if (relocate != nullptr)
+        relocate(&moved[m_offsets[index]], &m_buffer[m_offsets[index]]);
+    }
+
+    m_buffer = std::move(moved);
+  }
+
+  // The second half of the copy constructor: copy-constructs each live
+  // object of other over its bitwise copy. If a copy throws, the objects
+  // copied so far are destroyed, since the destructor does not run.
+  void copy_objects(const PolyVector &other) {
+    poly_data_t run_vptr = free_space;
+    copy_fn copy = nullptr;
+    size_t index = next_live(0);
+    try {
+      for (; index < size(); index = next_live(index + 1)) {
+        if (vptr_at(index) != run_vptr) {
+          run_vptr = vptr_at(index);
+          const TypeRecord *type = find_type(run_vptr);
+          copy = type ? type->copy : nullptr;
+        }
+        if (copy != nullptr)
+          copy(&m_buffer[m_offsets[index]], &other.m_buffer[m_offsets[index]]);
+      }
+    } catch (...) {
+      for (size_t copied = next_live(0); copied < index;
+           copied = next_live(copied + 1))
+        object_at(copied).~Base();
+      throw;
+    }
+  }
+
+  // Move assignment between allocators that neither propagate nor compare
+  // equal: this empty vector copies other's words into its own storage,
+  // relocates the objects that need it and takes the rest of the state.
+  // other is left empty without destroying anything twice.
+  void relocate_from(PolyVector &other) {
+    m_buffer.resize(other.m_buffer.size());
+    for (size_t word = 0; word < other.m_buffer.size(); ++word)
+      m_buffer[word] = other.m_buffer[word];
+    m_offsets = other.m_offsets;
+    m_slot_words = other.m_slot_words;
+    m_occupancy = other.m_occupancy;
+    m_free_regions = other.m_free_regions;
+    m_free_lists = other.m_free_lists;
+    m_free_classes = other.m_free_classes;
+    m_free_indices = other.m_free_indices;
+    m_free_count = other.m_free_count;
+    m_free_bytes = other.m_free_bytes;
+    m_free_histogram = other.m_free_histogram;
+    m_types = other.m_types;
+    m_relocated_types = other.m_relocated_types;
+    m_live_bytes = other.m_live_bytes;
+    m_compact_order = other.m_compact_order;
+    m_compact_end = other.m_compact_end;
+    m_compact_index = other.m_compact_index;
+    m_compact_cursor = other.m_compact_cursor;
+    m_generations = other.m_generations;
+    m_min_alignment = other.m_min_alignment;
+
+    poly_data_t run_vptr = free_space;
+    relocate_fn relocate = nullptr;
+    for (size_t index = next_live(0); index < size();
+         index = next_live(index + 1)) {
+      if (vptr_at(index) != run_vptr) {
+        run_vptr = vptr_at(index);
+        relocate = relocator(run_vptr);
+      }
+      if (relocate != nullptr)
+        relocate(&m_buffer[m_offsets[index]],
+                 &other.m_buffer[m_offsets[index]]);
+    }
+    // clear() forgets the objects without destroying them
+    other.clear();
+  }
+
+  // A live slot that free() or free_if() is about to free, with the
+  // vtable pointer of its object
+  struct FreedSlot {
+    size_t index;
+    poly_data_t vptr;
+  };
+
+  // The first phase of free_if() over the indices in [first, last): returns
+  // the slot of each live element for which pred(Base &) returns true, in
+  // index order. Nothing is written, so calls for disjoint ranges may run
+  // concurrently, and a throwing pred leaves the vector unchanged.
+  template <typename Predicate>
+  std::vector<FreedSlot> match_in_range(size_t first, size_t last,
+                                        Predicate &&pred) {
+    std::vector<FreedSlot> slots;
+    last = std::min(last, size());
+    for (size_t index = next_live(first); index < last;
+         index = next_live(index + 1)) {
+      if (pred(object_at(index)))
+        slots.push_back({index, vptr_at(index)});
+    }
+    return slots;
+  }
+
+  // The second phase: destroys the objects of slots. Only the objects are
+  // written, so calls for disjoint slots may run concurrently. The slots
+  // stay live until they are passed to release_slots(), and the vector must
+  // not be used in any other way until then.
+  void destroy_slots(std::span<const FreedSlot> slots) noexcept {
+    for (const FreedSlot &slot : slots)
+      destroy_at(slot.index);
+  }
+
+  // The last phase: frees slots, in ascending index order, whose objects
+  // are already destroyed
+  void release_slots(std::span<const FreedSlot> slots) {
+    TypeRecord *type = nullptr;
+    for (const FreedSlot &slot : slots) {
+      if (type == nullptr || type->vptr != slot.vptr)
+        type = find_type(slot.vptr);
+      if (type != nullptr) {
+        m_live_bytes -= type->size;
+        unmark_type(*type, slot.index);
+      }
+      if (slot.index < m_generations.size())
+        ++m_generations[slot.index];
+      m_occupancy[slot.index >> 6] &=
+          ~(occupancy_word_t(1) << (slot.index & 63));
+      release_slot(slot.index);
+    }
+  }
+
+  inline void destroy_at(size_t index) noexcept {
+    auto *object = reinterpret_cast<Base *>(&m_buffer[m_offsets[index]]);
+    object->~Base();
+    *reinterpret_cast<poly_data_t *>(object) =
+        free_space; // Zeroed the vtable-pointer
+  }
+
+  inline Base &object_at(size_t index) noexcept {
+    return *reinterpret_cast<Base *>(&m_buffer[m_offsets[index]]);
+  }
+
+  inline const Base &object_at(size_t index) const noexcept {
+    return *reinterpret_cast<const Base *>(&m_buffer[m_offsets[index]]);
+  }
+
+  inline poly_data_t vptr_at(size_t index) const noexcept {
+    return m_buffer[m_offsets[index]];
+  }
+
+  template <typename Object, typename Function>
+  size_t for_each_run(Function &fn, size_t index, poly_data_t vptr) {
+    do {
+      fn(static_cast<Object &>(object_at(index)));
+      index = next_live(index + 1);
+    } while (index < size() && vptr_at(index) == vptr);
+    return index;
+  }
+
+  template <typename Ret, typename... Params, typename Method,
+            typename... Args>
+  void invoke_runs(Method method, Args &...args) {
+    size_t index = next_live(0);
+    while (index < size()) {
+      poly_data_t vptr = vptr_at(index);
+#if defined(__GNUC__) && !defined(__clang__)
+      // GCC can bind a pointer to virtual member to the final overrider of an
+      // object, which gives the run a direct call target
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#pragma GCC diagnostic ignored "-Wpmf-conversions"
+      using target_t = Ret (*)(Base *, Params...);
+      auto target = reinterpret_cast<target_t>(object_at(index).*method);
+#pragma GCC diagnostic pop
+      do {
+        target(&object_at(index), args...);
+        index = next_live(index + 1);
+      } while (index < size() && vptr_at(index) == vptr);
+#else
+      do {
+        (object_at(index).*method)(args...);
+        index = next_live(index + 1);
+      } while (index < size() && vptr_at(index) == vptr);
+#endif
+    }
+  }
+
+  inline bool is_live(size_t index) const noexcept {
+    return (m_occupancy[index >> 6] >> (index & 63)) & 1;
+  }
+
+  inline void set_live(size_t index) noexcept {
+    m_occupancy[index >> 6] |= occupancy_word_t(1) << (index & 63);
+  }
+
+  void set_live_range(size_t first, size_t last) noexcept {
+    set_bit_range(m_occupancy.data(), first, last);
+  }
+
+  // First live index >= index, or size()
+  size_t next_live(size_t index) const noexcept {
+    return next_set_bit(m_occupancy.data(), m_occupancy.size(), index, size());
+  }
+
+  // Last live index <= index, or size_t(-1)
+  size_t prev_live(size_t index) const noexcept {
+    return prev_set_bit(m_occupancy.data(), index);
+  }
+
+  // First free index >= index, or size()
+  size_t next_free(size_t index) const noexcept {
+    size_t word = index >> 6;
+    size_t words = m_occupancy.size();
+    if (index >= size())
+      return size();
+
+    occupancy_word_t bits =
+        ~m_occupancy[word] & (~occupancy_word_t(0) << (index & 63));
+    while (bits == 0) {
+      if (++word >= words)
+        return size();
+      bits = ~m_occupancy[word];
+    }
+
+    return std::min((word << 6) + static_cast<size_t>(std::countr_zero(bits)),
+                    size());
+  }
+
+  // Largest offset the buffer and the offset type can both hold
+  size_t max_offset() const noexcept {
+    return std::min<size_t>(m_buffer.max_size(),
+                            std::numeric_limits<buffer_offset_t>::max());
+  }
+
+  static inline size_t align_class(size_t alignment) noexcept {
+    if (alignment <= 1)
+      return 0;
+    return std::min<size_t>(static_cast<size_t>(std::bit_width(alignment - 1)),
+                            free_align_classes - 1);
+  }
+
+  void list_region(size_t start, size_t words, size_t owner) {
+    m_free_regions.emplace(
+        static_cast<buffer_offset_t>(start),
+        FreeRegion{static_cast<buffer_offset_t>(words),
+                   static_cast<free_index_t>(owner)});
+    size_t align = free_class(start);
+    m_free_lists[align].emplace(static_cast<buffer_offset_t>(words),
+                                static_cast<buffer_offset_t>(start));
+    m_free_classes |= 1u << align;
+    m_free_bytes += words << poly_data_byte_scale;
+    ++m_free_histogram[histogram_bucket(words)];
+  }
+
+  void unlist_region(typename free_region_map_t::iterator region) noexcept {
+    size_t words = region->second.words;
+    size_t align = free_class(region->first);
+    m_free_lists[align].erase({region->second.words, region->first});
+    if (m_free_lists[align].empty())
+      m_free_classes &= ~(1u << align);
+    m_free_bytes -= words << poly_data_byte_scale;
+    --m_free_histogram[histogram_bucket(words)];
+    m_free_regions.erase(region);
+  }
+
+  static inline size_t free_class(size_t start) noexcept {
+    // Offset 0 is aligned to everything
+    return (start == 0) ? free_align_classes - 1
+                        : align_class(start & (~start + 1));
+  }
+
+  static inline size_t histogram_bucket(size_t words) noexcept {
+    return std::min<size_t>(static_cast<size_t>(std::bit_width(words)) - 1,
+                            free_histogram_buckets - 1);
+  }
+
+  // Empties the slot of a freed index. Its words join the free regions,
+  // except during a compaction: offsets the compaction has passed are
+  // compacted and the others are not, so the index is only counted and
+  // compact_step() lists the free space when it is done.
+  void release_slot(size_t index) {
+    size_t words = m_slot_words[index];
+    m_slot_words[index] = 0;
+    ++m_free_count;
+    if (compacting()) {
+      m_free_indices.push_back(static_cast<free_index_t>(index));
+      return;
+    }
+    release_region(m_offsets[index], words, index);
+  }
+
+  // Lists words at start, owned by owner, merged with the free regions
+  // right before and after them. A merged region that reaches the end of
+  // the buffer is not listed, the buffer ends where it starts instead.
+  void release_region(size_t start, size_t words, size_t owner) {
+    size_t end = start + words;
+    auto next = m_free_regions.lower_bound(static_cast<buffer_offset_t>(end));
+    if (next != m_free_regions.begin()) {
+      auto prev = std::prev(next);
+      if (prev->first + prev->second.words == start) {
+        start = prev->first;
+        owner = keep_owner(prev->second.owner, owner);
+        unlist_region(prev);
+      }
+    }
+    if (next != m_free_regions.end() && next->first == end) {
+      end += next->second.words;
+      owner = keep_owner(owner, next->second.owner);
+      unlist_region(next);
+    }
+
+    if (end == m_offsets.back()) {
+      m_offsets.back() = static_cast<buffer_offset_t>(start);
+      m_buffer.resize(start); // Never grows
+      if (owner != no_owner)
+        m_free_indices.push_back(static_cast<free_index_t>(owner));
+      return;
+    }
+    list_region(start, end - start, owner);
+  }
+
+  // The owner of two merging regions: the lower one's, so the index keeps
+  // its place in buffer order. The other index stays free without a
+  // region.
+  size_t keep_owner(size_t lower, size_t upper) {
+    if (lower == no_owner)
+      return upper;
+    if (upper != no_owner)
+      m_free_indices.push_back(static_cast<free_index_t>(upper));
+    return lower;
+  }
+
+  // Best fit among all alignment classes able to host the request: O(log n)
+  // per non-empty class. m_free_regions.end() when no region is large
+  // enough.
+  typename free_region_map_t::iterator best_free_region(size_t words,
+                                                        size_t align) {
+    free_bucket_t *best_bucket = nullptr;
+    typename free_bucket_t::iterator best;
+    for (uint32_t classes = m_free_classes >> align; classes != 0;
+         classes &= classes - 1) {
+      size_t c = align + static_cast<size_t>(std::countr_zero(classes));
+      auto &bucket = m_free_lists[c];
+      auto fit = bucket.lower_bound({static_cast<buffer_offset_t>(words), 0});
+      if (fit == bucket.end())
+        continue;
+      if (best_bucket == nullptr || fit->first < best->first) {
+        best_bucket = &bucket;
+        best = fit;
+      }
+    }
+
+    if (best_bucket == nullptr)
+      return m_free_regions.end();
+    return m_free_regions.find(best->second);
+  }
+
+  // The live indices ordered by the start of their slots. That is index
+  // order unless an insert placed a free index elsewhere, so the sort is
+  // usually skipped.
+  indices_t live_by_start() const {
+    indices_t indices(m_occupancy.get_allocator());
+    indices.reserve(size() - m_free_count);
+    for (size_t index = next_live(0); index < size();
+         index = next_live(index + 1)) {
+      indices.push_back(static_cast<free_index_t>(index));
+    }
+    auto by_start = [this](free_index_t a, free_index_t b) {
+      return m_offsets[a] < m_offsets[b];
+    };
+    if (!std::is_sorted(indices.begin(), indices.end(), by_start))
+      std::sort(indices.begin(), indices.end(), by_start);
+    return indices;
+  }
+
+  // Lists each gap between live slots as a free region and every free index
+  // as one without a region, lowest index on top. Space past the last slot
+  // is dropped from the buffer.
+  void rebuild_free_lists() {
+    clear_free_lists();
+    size_t end = 0;
+    for (size_t index : live_by_start()) {
+      if (m_offsets[index] != end)
+        list_region(end, m_offsets[index] - end, no_owner);
+      end = m_offsets[index] + m_slot_words[index];
+    }
+    m_offsets.back() = static_cast<buffer_offset_t>(end);
+    m_buffer.resize(end); // Never grows
+
+    for (size_t index = size(); index-- > 0;) {
+      if (!is_live(index))
+        m_free_indices.push_back(static_cast<free_index_t>(index));
+    }
+    m_free_count = m_free_indices.size();
+  }
+
+  // Orders the live indices for compact_step() and drops the free regions,
+  // whose space the compaction squeezes out. Their owners stay free
+  // indices.
+  void start_compaction() {
+    m_compact_order = live_by_start();
+    for (auto &[start, region] : m_free_regions) {
+      if (region.owner != no_owner)
+        m_free_indices.push_back(region.owner);
+    }
+    clear_free_regions();
+    m_compact_end = size();
+    m_compact_index = 0;
+    m_compact_cursor = 0;
+  }
+
+  // Compaction places objects with the current minimum alignment, which
+  // may differ from the one they were inserted with
+  size_t compact_alignment(const TypeRecord *type) const noexcept {
+    return placed_alignment(type ? type->alignment
+                                 : alignof(std::max_align_t));
+  }
+
+  void clear_free_regions() noexcept {
+    m_free_regions.clear();
+    for (auto &bucket : m_free_lists) {
+      bucket.clear();
+    }
+    m_free_classes = 0;
+    m_free_bytes = 0;
+    m_free_histogram = {};
+  }
+
+  void clear_free_lists() noexcept {
+    clear_free_regions();
+    m_free_indices.clear();
+    m_free_count = 0;
+  }
+
+  inline void check_bounds(const char *caller, size_t index) const {
+    if (index >= size()) {
+      throw std::out_of_range("somm::PolyVector::" + std::string(caller) +
+                              ": index " + std::to_string(index) +
+                              " not less than size " + std::to_string(size()));
+    }
+  }
+
+  static inline size_t align(size_t offset, size_t alignment) noexcept {
+    return (offset + alignment - 1) & ~(alignment - 1);
+  }
+
+  // index -> offsets[index] : offset -> buffer[offset] : data, and
+  // free_lists[align][words] : start -> free_regions[start] : owner
+  buffer_t m_buffer;
+  offsets_t m_offsets;    // Slot start of each index, then the buffer end
+  offsets_t m_slot_words; // Slot size of each index, 0 when it is free
+  occupancy_t m_occupancy; // Bit i set when index i is live
+  free_region_map_t m_free_regions;
+  free_lists_t m_free_lists;
+  uint32_t m_free_classes = 0; // Bit c set when m_free_lists[c] is non-empty
+  indices_t m_free_indices; // Free indices owning no region
+  size_t m_free_count = 0;                  // Free indices
+  size_t m_free_bytes = 0;                  // In free regions
+  std::array<size_t, free_histogram_buckets> m_free_histogram = {};
+  types_t m_types;
+  size_t m_relocated_types = 0; // m_types entries with a relocate function
+  size_t m_live_bytes = 0;
+  // compact_step() moves the live indices of m_compact_order, then the ones
+  // appended from m_compact_end on
+  indices_t m_compact_order;
+  size_t m_compact_end = 0;
+  size_t m_compact_index = not_compacting; // Next m_compact_order position
+  size_t m_compact_cursor = 0;    // End of the compacted objects
+  // Per slot, up to the highest index handle() was called for
+  generations_t m_generations;
+  size_t m_min_alignment = sizeof(poly_data_t); // In bytes
+};
+
+// Lock-free appends into capacity reserved up front. The next index and the
+// next buffer offset are packed into one 64-bit word and bumped together with
+// a compare-exchange, so offsets stay increasing in index order like in
+// buffer_write_back(). Objects are constructed concurrently, and
+// published_size() only counts the prefix of indices whose objects are fully
+// constructed.
+template <typename Base, typename Storage, typename Allocator, typename Offset>
+class PolyVector<Base, Storage, Allocator, Offset>::ConcurrentAppender {
+public:
+  static constexpr size_t npos = size_t(-1);
+  static constexpr size_t max_capacity = UINT32_MAX;
+  // Distinct types one appender can take
+  static constexpr size_t max_types = 32;
+
+  ConcurrentAppender(const ConcurrentAppender &) = delete;
+  ConcurrentAppender &operator=(const ConcurrentAppender &) = delete;
+
+  ~ConcurrentAppender() noexcept { finish(); }
+
+  // Returns the index of the new element, or npos when the reserved elements
+  // or bytes are used up or Derived would be type number max_types + 1
+  template <typename Derived, typename... Args>
+  size_t emplace_back(Args &&...args) noexcept {
+    assert_insertable<Derived>();
+    TypeNote *note =
+        note_type(&typeid(Derived), sizeof(Derived), alignof(Derived),
+                  relocator_of<Derived>(), &copy_object<Derived>);
+    if (note == nullptr)
+      return npos;
+
+    size_t words = m_vector->placed_words(sizeof(Derived));
+    size_t alignment = m_vector->placed_alignment(alignof(Derived));
+    uint64_t next = m_next.load(std::memory_order_relaxed);
+    uint64_t index;
+    size_t start;
+    do {
+      index = next >> 32;
+      start = Storage::place(
+          align(m_base_cursor + (next & UINT32_MAX), alignment), words);
+      if (index >= m_capacity_elements ||
+          start + words - m_base_cursor > m_capacity_words)
+        return npos;
+    } while (!m_next.compare_exchange_weak(
+        next, ((index + 1) << 32) | (start + words - m_base_cursor),
+        std::memory_order_relaxed));
+
+    PolyVector &vector = *m_vector;
+    size_t slot = m_base_index + static_cast<size_t>(index);
+    vector.take_slot(slot, start, words);
+    new (&vector.m_buffer[start]) Derived(std::forward<Args>(args)...);
+    note->vptr.store(vector.vptr_at(slot), std::memory_order_release);
+    m_live_bytes.fetch_add(sizeof(Derived), std::memory_order_relaxed);
+    publish(slot);
+    return slot;
+  }
+
+  // Every index below this holds a fully constructed object
+  size_t published_size() const noexcept {
+    return m_base_index + m_published.load(std::memory_order_acquire);
+  }
+
+  // Safe to call while other threads append; nullptr for freed or not yet
+  // published indices
+  Base *operator[](size_t index) const noexcept {
+    if (index >= published_size() || !is_set(index))
+      return nullptr;
+    PolyVector &vector = *m_vector;
+    return reinterpret_cast<Base *>(&vector.m_buffer[vector.m_offsets[index]]);
+  }
+
+  // Hands the vector back once every emplace_back() has returned: trims the
+  // reserved space to what was used
+  void finish() noexcept {
+    if (m_vector == nullptr)
+      return;
+
+    PolyVector &vector = *m_vector;
+    uint64_t next = m_next.load(std::memory_order_acquire);
+    size_t count = static_cast<size_t>(next >> 32);
+    size_t cursor = m_base_cursor + (next & UINT32_MAX);
+    vector.m_offsets.resize(m_base_index + count + 1);
+    vector.m_offsets.back() = static_cast<buffer_offset_t>(cursor);
+    vector.m_slot_words.resize(m_base_index + count);
+    vector.list_append_gaps(m_base_index, m_base_cursor);
+    vector.m_buffer.resize(cursor);
+    vector.m_occupancy.resize((m_base_index + count + 63) >> 6);
+
+    size_t notes = std::min(m_note_count.load(), max_types);
+    for (size_t i = 0; i < notes; ++i) {
+      poly_data_t vptr = m_notes[i].vptr.load(std::memory_order_acquire);
+      if (vptr != free_space)
+        vector.add_type(vptr, m_notes[i].type.load(), m_notes[i].size,
+                        m_notes[i].alignment, m_notes[i].relocate,
+                        m_notes[i].copy);
+    }
+
+    poly_data_t run_vptr = free_space;
+    TypeRecord *type = nullptr;
+    for (size_t index = vector.next_live(m_base_index); index < vector.size();
+         index = vector.next_live(index + 1)) {
+      if (vector.vptr_at(index) != run_vptr) {
+        run_vptr = vector.vptr_at(index);
+        type = vector.find_type(run_vptr);
+      }
+      mark_type(*type, index, index + 1);
+    }
+    vector.m_live_bytes += m_live_bytes.load();
+    m_vector = nullptr;
+  }
+
+private:
+  friend class PolyVector;
+
+  // A type is claimed before its first object is constructed and gets its
+  // vtable pointer after. Racing threads may claim duplicates.
+  struct TypeNote {
+    std::atomic<const std::type_info *> type = nullptr;
+    size_t size = 0;
+    size_t alignment = 0;
+    relocate_fn relocate = nullptr;
+    copy_fn copy = nullptr;
+    std::atomic<poly_data_t> vptr = free_space;
+  };
+
+  ConcurrentAppender(PolyVector &vector, size_t words, size_t elements)
+      : m_vector(&vector), m_base_index(vector.size()),
+        m_base_cursor(vector.m_offsets.back()), m_capacity_words(words),
+        m_capacity_elements(elements) {
+    if (words > max_capacity || elements > max_capacity)
+      throw std::length_error("somm::PolyVector::concurrent_appender: "
+                              "capacity exceeds " +
+                              std::to_string(max_capacity));
+    if (m_base_cursor + words > vector.max_offset())
+      throw std::length_error("somm::PolyVector::concurrent_appender: "
+                              "buffer would exceed the offset range");
+    vector.grow_buffer(m_base_cursor + words);
+    vector.m_offsets.resize(m_base_index + elements + 1);
+    vector.m_slot_words.resize(m_base_index + elements);
+    vector.m_occupancy.resize((m_base_index + elements + 63) >> 6);
+  }
+
+  TypeNote *note_type(const std::type_info *type, size_t size,
+                      size_t alignment, relocate_fn relocate,
+                      copy_fn copy) noexcept {
+    size_t notes = std::min(m_note_count.load(), max_types);
+    for (size_t i = 0; i < notes; ++i) {
+      if (m_notes[i].type.load(std::memory_order_acquire) == type)
+        return &m_notes[i];
+    }
+
+    size_t claimed = m_note_count.fetch_add(1);
+    if (claimed >= max_types)
+      return nullptr;
+    m_notes[claimed].size = size;
+    m_notes[claimed].alignment = alignment;
+    m_notes[claimed].relocate = relocate;
+    m_notes[claimed].copy = copy;
+    m_notes[claimed].type.store(type, std::memory_order_release);
+    return &m_notes[claimed];
+  }
+
+  bool is_set(size_t index) const noexcept {
+    std::atomic_ref<occupancy_word_t> word(m_vector->m_occupancy[index >> 6]);
+    return (word.load() >> (index & 63)) & 1;
+  }
+
+  // Marks index live, then moves the published prefix over every index
+  // that is already live. Whichever thread completes the last missing index
+  // carries the prefix past the indices completed before it.
+  void publish(size_t index) noexcept {
+    std::atomic_ref<occupancy_word_t> word(m_vector->m_occupancy[index >> 6]);
+    word.fetch_or(occupancy_word_t(1) << (index & 63));
+
+    size_t published = m_published.load();
+    while (published < m_capacity_elements &&
+           is_set(m_base_index + published)) {
+      if (m_published.compare_exchange_weak(published, published + 1))
+        ++published;
+    }
+  }
+
+  PolyVector *m_vector;
+  size_t m_base_index;
+  size_t m_base_cursor;
+  size_t m_capacity_words;
+  size_t m_capacity_elements;
+  std::atomic<uint64_t> m_next = 0; // (index << 32) | words past base cursor
+  std::atomic<size_t> m_published = 0;
+  std::atomic<size_t> m_live_bytes = 0;
+  std::atomic<size_t> m_note_count = 0;
+  std::array<TypeNote, max_types> m_notes;
+};
+
+// A PolyVector restricted to a list of types known at compile time. Every
+// element also carries a 1-byte tag naming its type, so visit() and
+// for_each() switch on the tag and call fn with the concrete type, which lets
+// the compiler inline the call instead of going through the vtable.
+template <typename Base, typename... Types> class ClosedPolyVector {
+public:
+  static_assert(sizeof...(Types) > 0, "The type list must not be empty");
+  static_assert(sizeof...(Types) <= 256, "A type tag holds at most 256 types");
+  static_assert((std::is_base_of_v<Base, Types> && ...),
+                "Type must derive from Base");
+
+  using vector_type = PolyVector<Base>;
+  using type_tag_t = uint8_t;
+
+  template <typename Derived>
+  static constexpr size_t count_of =
+      (size_t(std::is_same_v<Derived, Types>) + ...);
+
+  static_assert(((count_of<Types> == 1) && ...),
+                "Each type may appear only once in the list");
+
+  template <typename Derived>
+  static constexpr bool holds = count_of<Derived> != 0;
+
+  template <typename Derived>
+    requires holds<Derived>
+  static constexpr type_tag_t tag_of = [] {
+    constexpr std::array<bool, sizeof...(Types)> matches = {
+        std::is_same_v<Derived, Types>...};
+    return static_cast<type_tag_t>(
+        std::find(matches.begin(), matches.end(), true) - matches.begin());
+  }();
+
+  // Indexed by tag
+  static constexpr std::array<size_t, sizeof...(Types)> type_sizes = {
+      sizeof(Types)...};
+  static constexpr std::array<size_t, sizeof...(Types)> type_alignments = {
+      alignof(Types)...};
+
+  size_t size() const noexcept { return m_vector.size(); }
+
+  bool empty() const noexcept { return m_vector.empty(); }
+
+  size_t free_count() const noexcept { return m_vector.free_count(); }
+
+  // Read-only: inserting through the PolyVector itself would skip the tag
+  const vector_type &vector() const noexcept { return m_vector; }
+
+  Base *operator[](size_t index) noexcept { return m_vector[index]; }
+
+  Base *at(size_t index) { return m_vector.at(index); }
+
+  bool is_free(size_t index) const { return m_vector.is_free(index); }
+
+  using Handle = typename vector_type::Handle;
+
+  Handle handle(size_t index) { return m_vector.handle(index); }
+
+  bool valid(Handle handle) const noexcept { return m_vector.valid(handle); }
+
+  Base *get(Handle handle) noexcept { return m_vector.get(handle); }
+
+  type_tag_t tag_at(size_t index) const {
+    m_vector.check_bounds("tag_at()", index);
+    return m_tags[index];
+  }
+
+  void free(size_t index) { m_vector.free(index); }
+
+  void free(std::span<const size_t> indices) { m_vector.free(indices); }
+
+  template <typename Predicate> size_t free_if(Predicate &&pred) {
+    return m_vector.free_if(std::forward<Predicate>(pred));
+  }
+
+  void free_all() {
+    m_vector.free_all();
+    m_tags.clear();
+  }
+
+  void clear() noexcept {
+    m_vector.clear();
+    m_tags.clear();
+  }
+
+  void shrink_to_fit() noexcept {
+    m_vector.shrink_to_fit();
+    m_tags.shrink_to_fit();
+  }
+
+  void compact() { m_vector.compact(); }
+
+  bool compact_step(size_t byte_budget) {
+    return m_vector.compact_step(byte_budget);
+  }
+
+  typename vector_type::Stats stats() const noexcept {
+    return m_vector.stats();
+  }
+
+  void reserve_buffer(size_t bytes) { m_vector.reserve_buffer(bytes); }
+
+  void set_min_alignment(size_t bytes) { m_vector.set_min_alignment(bytes); }
+
+  size_t min_alignment() const noexcept { return m_vector.min_alignment(); }
+
+  void reserve_elements(size_t n) {
+    m_vector.reserve_elements(n);
+    m_tags.reserve(n);
+  }
+
+  template <typename Derived>
+    requires holds<Derived>
+  size_t push_back(const Derived &object) noexcept {
+    return tag(m_vector.push_back(object), tag_of<Derived>);
+  }
+
+  template <typename Derived>
+    requires holds<Derived>
+  size_t push(const Derived &object) noexcept {
+    return tag(m_vector.push(object), tag_of<Derived>);
+  }
+
+  template <typename Derived, typename... Args>
+    requires holds<Derived>
+  size_t emplace_back(Args &&...args) noexcept {
+    return tag(m_vector.template emplace_back<Derived>(
+                   std::forward<Args>(args)...),
+               tag_of<Derived>);
+  }
+
+  template <typename Derived, typename... Args>
+    requires holds<Derived>
+  size_t emplace(Args &&...args) noexcept {
+    return tag(
+        m_vector.template emplace<Derived>(std::forward<Args>(args)...),
+        tag_of<Derived>);
+  }
+
+  template <typename Derived>
+    requires holds<Derived>
+  typename vector_type::template TypeView<Derived> view() noexcept {
+    return m_vector.template view<Derived>();
+  }
+
+  template <typename Derived, typename... Args>
+    requires holds<Derived>
+  size_t emplace_n(size_t count, const Args &...args) noexcept {
+    return tag_range(m_vector.template emplace_n<Derived>(count, args...),
+                     tag_of<Derived>);
+  }
+
+  template <std::ranges::forward_range Range>
+    requires holds<std::ranges::range_value_t<Range>>
+  size_t append_range(Range &&range) noexcept {
+    return tag_range(m_vector.append_range(std::forward<Range>(range)),
+                     tag_of<std::ranges::range_value_t<Range>>);
+  }
+
+  // Returns fn(Derived &) for the element at index, Derived being its type
+  // in the list
+  template <typename Function>
+  decltype(auto) visit(size_t index, Function &&fn) {
+    Base *object = m_vector.at(index);
+    if (object == nullptr) {
+      throw std::out_of_range("somm::ClosedPolyVector::visit(): index " +
+                              std::to_string(index) + " is freed");
+    }
+    return dispatch(m_tags[index], *object, fn);
+  }
+
+  // Calls fn(Derived &) on every live element in index order
+  template <typename Function> void for_each(Function &&fn) {
+    for (size_t index = m_vector.next_live(0); index < size();
+         index = m_vector.next_live(index + 1)) {
+      dispatch(m_tags[index], m_vector.object_at(index), fn);
+    }
+  }
+
+private:
+  template <size_t Tag>
+  using type_at = std::tuple_element_t<Tag, std::tuple<Types...>>;
+
+  // An if chain over the tags that the compiler turns into a switch
+  template <size_t Tag = 0, typename Function>
+  static decltype(auto) dispatch(type_tag_t tag, Base &object, Function &fn) {
+    if constexpr (Tag + 1 == sizeof...(Types)) {
+      return fn(static_cast<type_at<Tag> &>(object));
+    } else {
+      if (tag == Tag)
+        return fn(static_cast<type_at<Tag> &>(object));
+      return dispatch<Tag + 1>(tag, object, fn);
+    }
+  }
+
+  size_t tag(size_t index, type_tag_t type) {
+    if (index >= size())
+      return index;
+    if (index >= m_tags.size())
+      m_tags.resize(index + 1);
+    m_tags[index] = type;
+    return index;
+  }
+
+  // Tags every index from first, which emplace_n() and append_range() return,
+  // to the end
+  size_t tag_range(size_t first, type_tag_t type) {
+    if (first >= size())
+      return first;
+    m_tags.resize(size(), type);
+    std::fill(m_tags.begin() + static_cast<std::ptrdiff_t>(first),
+              m_tags.end(), type);
+    return first;
+  }
+
+  vector_type m_vector;
+  std::vector<type_tag_t> m_tags; // m_tags[index] : tag of the object
+};
+
+// 32-bit offset table: half the footprint of the default, for buffers up to
+// 32 GiB on 64-bit targets
+template <typename Base, typename Storage = ContiguousStorage<>,
+          typename Allocator = std::allocator<poly_data_t>>
+using PolyVector32 = PolyVector<Base, Storage, Allocator, uint32_t>;
+
+namespace pmr {
+template <typename Base, typename Storage = ContiguousStorage<>>
+using PolyVector =
+    somm::PolyVector<Base, Storage,
+                     std::pmr::polymorphic_allocator<poly_data_t>>;
+} // namespace pmr
+
+} // namespace somm
+
+// size() counts freed indices, so it is not the length of the element range.
+// std::ranges::size() of a FrozenPolyVector falls back to end() - begin(),
+// and live() is the sized range of a PolyVector.
+template <typename Base, typename Storage, typename Allocator, typename Offset>
+inline constexpr bool std::ranges::disable_sized_range<
+    somm::PolyVector<Base, Storage, Allocator, Offset>> = true;
+
+template <typename Base, typename Offset>
+inline constexpr bool
+    std::ranges::disable_sized_range<somm::FrozenPolyVector<Base, Offset>> =
+        true;
 
 #endif
\ No newline at end of file
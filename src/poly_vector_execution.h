@@ -0,0 +1,130 @@
+#ifndef POLY_VECTOR_EXECUTION_H
+#define POLY_VECTOR_EXECUTION_H
+
+#include "poly_vector.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <execution>
+#include <numeric>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Parallel algorithms over a PolyVector, built on the standard execution
+// policies. Kept out of poly_vector.h since the parallel policies may pull in
+// a threading backend (TBB for libstdc++) that has to be linked.
+
+namespace somm {
+
+// Ranges per hardware thread, so the backend's work stealing can rebalance
+// ranges whose elements are more expensive than their size suggests
+inline constexpr size_t parallel_ranges_per_thread = 8;
+
+template <typename Base, typename Storage, typename Allocator, typename Offset>
+std::vector<size_t>
+parallel_bounds(const PolyVector<Base, Storage, Allocator, Offset> &vector) {
+  size_t threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  return vector.byte_balanced_bounds(threads * parallel_ranges_per_thread);
+}
+
+// Calls fn(Base &) on every live element. The indices are split into ranges
+// covering about the same number of buffer bytes, so the work stays balanced
+// when object sizes vary. fn must be safe to call concurrently on distinct
+// elements.
+template <typename ExecutionPolicy, typename Base, typename Storage,
+          typename Allocator, typename Offset, typename Function>
+  requires std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>>
+void for_each(ExecutionPolicy &&policy,
+              PolyVector<Base, Storage, Allocator, Offset> &vector,
+              Function &&fn) {
+  std::vector<size_t> bounds = parallel_bounds(vector);
+  std::vector<size_t> ranges(bounds.size() - 1);
+  std::iota(ranges.begin(), ranges.end(), size_t(0));
+  std::for_each(std::forward<ExecutionPolicy>(policy), ranges.begin(),
+                ranges.end(), [&](size_t range) {
+                  vector.for_each_in_range(bounds[range], bounds[range + 1],
+                                           fn);
+                });
+}
+
+// Reduces transform(Base &) over every live element. Ranges are reduced
+// concurrently and then folded into init in index order, so reduce only has
+// to be associative.
+template <typename ExecutionPolicy, typename Base, typename Storage,
+          typename Allocator, typename Offset, typename T, typename BinaryOp,
+          typename UnaryOp>
+  requires std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>>
+T transform_reduce(ExecutionPolicy &&policy,
+                   PolyVector<Base, Storage, Allocator, Offset> &vector,
+                   T init, BinaryOp reduce, UnaryOp transform) {
+  std::vector<size_t> bounds = parallel_bounds(vector);
+  std::vector<size_t> ranges(bounds.size() - 1);
+  std::iota(ranges.begin(), ranges.end(), size_t(0));
+  std::vector<std::optional<T>> partials(ranges.size());
+  std::for_each(std::forward<ExecutionPolicy>(policy), ranges.begin(),
+                ranges.end(), [&](size_t range) {
+                  std::optional<T> &partial = partials[range];
+                  vector.for_each_in_range(
+                      bounds[range], bounds[range + 1], [&](Base &object) {
+                        if (partial)
+                          partial = reduce(std::move(*partial),
+                                           transform(object));
+                        else
+                          partial.emplace(transform(object));
+                      });
+                });
+
+  for (auto &partial : partials) {
+    if (partial)
+      init = reduce(std::move(init), std::move(*partial));
+  }
+  return init;
+}
+
+// Frees every live element for which pred(Base &) returns true. The ranges
+// are scanned concurrently, then their matching objects are destroyed
+// concurrently, and the freed slots reach the bitmap and the free lists in
+// one serial pass. pred sees every element before any is destroyed. pred must
+// be safe to call concurrently on distinct elements. Returns the number of
+// elements freed. The policy is checked by a static_assert rather than a
+// constraint so that this matches the friend declaration in PolyVector.
+template <typename ExecutionPolicy, typename Base, typename Storage,
+          typename Allocator, typename Offset, typename Predicate>
+size_t free_if(ExecutionPolicy &&policy,
+               PolyVector<Base, Storage, Allocator, Offset> &vector,
+               Predicate &&pred) {
+  static_assert(
+      std::is_execution_policy_v<std::remove_cvref_t<ExecutionPolicy>>,
+      "free_if() takes an execution policy first");
+  using slots_t = std::vector<
+      typename PolyVector<Base, Storage, Allocator, Offset>::FreedSlot>;
+  std::vector<size_t> bounds = parallel_bounds(vector);
+  std::vector<size_t> ranges(bounds.size() - 1);
+  std::iota(ranges.begin(), ranges.end(), size_t(0));
+  std::vector<slots_t> freed(ranges.size());
+  std::for_each(policy, ranges.begin(), ranges.end(), [&](size_t range) {
+    freed[range] =
+        vector.match_in_range(bounds[range], bounds[range + 1], pred);
+  });
+
+  slots_t slots;
+  size_t count = 0;
+  for (const auto &range_slots : freed)
+    count += range_slots.size();
+  slots.reserve(count);
+  for (const auto &range_slots : freed)
+    slots.insert(slots.end(), range_slots.begin(), range_slots.end());
+
+  std::for_each(std::forward<ExecutionPolicy>(policy), ranges.begin(),
+                ranges.end(),
+                [&](size_t range) { vector.destroy_slots(freed[range]); });
+  vector.release_slots(slots);
+  return count;
+}
+
+} // namespace somm
+
+#endif
@@ -0,0 +1,909 @@
+#include "poly_vector.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <random>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Regression tests for PolyVector. Each test aborts with the failing
+// expression, and the target is built with the sanitizers of the rest of the
+// project, so memory errors fail the test as well.
+
+#define CHECK(expression)                                                      \
+  do {                                                                         \
+    if (!(expression)) {                                                       \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__,  \
+                   #expression);                                               \
+      std::abort();                                                            \
+    }                                                                          \
+  } while (false)
+
+namespace {
+
+struct Shape {
+  virtual ~Shape() = default;
+  virtual size_t value() const = 0;
+};
+
+// Not trivially relocatable: the string may point into the object itself
+struct Named final : Shape {
+  explicit Named(std::string text) : name(std::move(text)) {}
+
+  size_t value() const override { return name.size(); }
+
+  std::string name;
+};
+
+// 16 bytes, smaller than Named
+struct Tag final : Shape {
+  size_t value() const override { return 1; }
+
+  size_t id = 0;
+};
+
+struct alignas(32) Wide final : Shape {
+  size_t value() const override { return 2; }
+};
+
+// 256 bytes, a hole that fits many Tags
+struct Block final : Shape {
+  size_t value() const override { return 4; }
+
+  std::array<std::byte, 248> bytes = {};
+};
+
+} // namespace
+
+// Both can be restored from an image
+template <> struct somm::is_trivially_relocatable<Tag> : std::true_type {};
+template <> struct somm::is_trivially_relocatable<Wide> : std::true_type {};
+
+// Counts global allocations while counting_new is set, to catch tables that
+// bypass the vector's allocator
+static bool counting_new = false;
+static size_t global_news = 0;
+
+void *operator new(size_t size) {
+  if (counting_new)
+    ++global_news;
+  if (void *memory = std::malloc(size == 0 ? 1 : size))
+    return memory;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+
+void operator delete(void *memory, size_t) noexcept { std::free(memory); }
+
+namespace {
+
+size_t total(const somm::PolyVector<Shape> &vector) {
+  size_t sum = 0;
+  for (const Shape &shape : vector)
+    sum += shape.value();
+  return sum;
+}
+
+// reserve_buffer() and shrink_to_fit() reallocate the buffer, which has to
+// relocate objects that are not trivially relocatable
+void test_reserve_and_shrink_relocate() {
+  somm::PolyVector<Shape> vector;
+  vector.emplace_back<Named>("short");
+  vector.reserve_buffer(size_t(1) << 20);
+  CHECK(total(vector) == 5);
+
+  for (int i = 0; i < 100; ++i)
+    vector.emplace_back<Named>("short");
+  vector.shrink_to_fit();
+  CHECK(total(vector) == 505);
+}
+
+// Not copy constructible, so a vector holding one cannot be copied
+struct Unique final : Shape {
+  size_t value() const override { return *number; }
+
+  std::unique_ptr<size_t> number = std::make_unique<size_t>(3);
+};
+
+// Copies construct each object anew and moves leave the source empty, so a
+// std::string member is neither shared nor freed twice
+void test_copy_and_move_own_their_objects() {
+  somm::PolyVector<Shape> vector;
+  for (int i = 0; i < 20; ++i)
+    vector.emplace_back<Named>("a string too long for the small buffer");
+  vector.emplace_back<Tag>();
+  vector.free(3);
+  size_t expected = total(vector);
+
+  somm::PolyVector<Shape> copy(vector);
+  CHECK(total(copy) == expected);
+  CHECK(copy[3] == nullptr);
+  CHECK(copy.free_count() == 1);
+  static_cast<Named *>(copy[0])->name = "changed";
+  CHECK(total(vector) == expected);
+
+  somm::PolyVector<Shape> assigned;
+  assigned.emplace_back<Named>("replaced by the assignment below");
+  assigned = vector;
+  CHECK(total(assigned) == expected);
+
+  somm::PolyVector<Shape> moved(std::move(vector));
+  CHECK(total(moved) == expected);
+  CHECK(vector.size() == 0);
+  vector.emplace_back<Named>("the moved-from vector is still usable");
+
+  assigned = std::move(moved);
+  CHECK(total(assigned) == expected);
+  CHECK(moved.size() == 0);
+
+  somm::PolyVector<Shape, somm::PagedStorage<64>> paged;
+  for (int i = 0; i < 20; ++i)
+    paged.emplace_back<Named>("a string too long for the small buffer");
+  somm::PolyVector<Shape, somm::PagedStorage<64>> paged_copy(paged);
+  size_t sum = 0;
+  paged_copy.for_each([&](Shape &shape) { sum += shape.value(); });
+  CHECK(sum == 20 * 38);
+}
+
+// A copy that throws destroys what it already copied
+void test_copy_of_uncopyable_type_throws() {
+  somm::PolyVector<Shape> vector;
+  vector.emplace_back<Named>("a string too long for the small buffer");
+  vector.emplace_back<Unique>();
+  bool thrown = false;
+  try {
+    somm::PolyVector<Shape> copy(vector);
+  } catch (const std::invalid_argument &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+  CHECK(total(vector) == 41);
+}
+
+// Moving between memory resources that differ relocates the objects into
+// the target's own storage
+void test_move_between_memory_resources() {
+  std::pmr::monotonic_buffer_resource first_resource, second_resource;
+  somm::pmr::PolyVector<Shape> first(&first_resource);
+  somm::pmr::PolyVector<Shape> second(&second_resource);
+  for (int i = 0; i < 20; ++i)
+    first.emplace_back<Named>("a string too long for the small buffer");
+  second = std::move(first);
+  CHECK(second.get_allocator().resource() == &second_resource);
+  CHECK(second.size() == 20);
+  CHECK(first.size() == 0);
+  size_t sum = 0;
+  for (const Shape &shape : second)
+    sum += shape.value();
+  CHECK(sum == 20 * 38);
+}
+
+// Every table the vector keeps beside its buffer, including the free
+// regions, the type bitmaps, the handle generations and the compaction
+// order, comes from the vector's allocator
+void test_tables_use_the_allocator() {
+  static std::array<std::byte, 1 << 16> arena;
+  std::pmr::monotonic_buffer_resource resource(
+      arena.data(), arena.size(), std::pmr::null_memory_resource());
+  somm::pmr::PolyVector<Shape> vector(&resource);
+
+  counting_new = true;
+  for (int i = 0; i < 40; ++i) {
+    vector.emplace_back<Tag>();
+    vector.emplace_back<Named>("short");
+  }
+  auto handle = vector.handle(79);
+  for (size_t index = 0; index < 40; index += 3)
+    vector.free(index);
+  vector.emplace<Tag>();
+  CHECK(!vector.compact_step(sizeof(Tag)));
+  vector.free(41);
+  vector.compact();
+  size_t tags = 0;
+  for (Tag &tag : vector.view<Tag>())
+    tags += tag.value();
+  counting_new = false;
+
+  CHECK(global_news == 0);
+  CHECK(tags == 34);
+  CHECK(vector.valid(handle));
+}
+
+// Objects that are not trivially relocatable are moved through scratch
+// space when their new place overlaps the old one
+void test_compact_moves_overlapping_objects() {
+  somm::PolyVector<Shape> vector;
+  vector.emplace_back<Tag>();
+  for (int i = 0; i < 50; ++i)
+    vector.emplace_back<Named>("a string too long for the small buffer");
+  size_t expected = total(vector) - 1;
+
+  vector.free(0);
+  vector.compact();
+  CHECK(vector.stats().buffer_bytes == 50 * sizeof(Named));
+  CHECK(total(vector) == expected);
+}
+
+// A free() during an unfinished compaction sees compacted offsets below
+// the cursor and uncompacted ones above it, so it must not list the slot
+// before the compaction is done
+void test_free_during_compaction_keeps_stats() {
+  somm::PolyVector<Shape> vector;
+  for (int i = 0; i < 10; ++i)
+    vector.emplace_back<Tag>();
+  vector.free(0);
+  CHECK(!vector.compact_step(sizeof(Tag)));
+  vector.free(1);
+  auto stats = vector.stats();
+  CHECK(stats.free_bytes + stats.live_bytes <= stats.buffer_bytes);
+
+  vector.compact();
+  stats = vector.stats();
+  CHECK(stats.buffer_bytes == 9 * sizeof(Tag));
+  CHECK(stats.free_bytes == sizeof(Tag));
+  CHECK(stats.padding_bytes == 0);
+  CHECK(vector.free_count() == 2);
+  CHECK(vector.emplace<Tag>() < 2);
+}
+
+// An object reusing part of an isolated hole only takes its own slot, and
+// the rest of the hole stays free for the next insert
+void test_reused_hole_keeps_its_rest_free() {
+  somm::PolyVector<Shape> vector;
+  vector.emplace_back<Tag>();
+  vector.emplace_back<Block>();
+  vector.emplace_back<Tag>();
+  vector.free(1);
+  size_t buffer_bytes = vector.stats().buffer_bytes;
+
+  CHECK(vector.emplace<Tag>() == 1);
+  auto stats = vector.stats();
+  CHECK(stats.padding_bytes == 0);
+  CHECK(stats.free_bytes == sizeof(Block) - sizeof(Tag));
+  CHECK(vector.size_at(1) == sizeof(Tag));
+
+  CHECK(vector.emplace<Tag>() == 3);
+  stats = vector.stats();
+  CHECK(stats.buffer_bytes == buffer_bytes);
+  CHECK(stats.free_bytes == sizeof(Block) - 2 * sizeof(Tag));
+
+  // Freed again, the pieces merge back into the hole
+  vector.free(3);
+  vector.free(1);
+  stats = vector.stats();
+  CHECK(stats.free_bytes == sizeof(Block));
+  CHECK(stats.largest_free_slot == sizeof(Block));
+  CHECK(vector.free_count() == 2);
+  CHECK(vector.emplace<Block>() == 1);
+  CHECK(vector.stats().buffer_bytes == buffer_bytes);
+  CHECK(total(vector) == 6);
+}
+
+// compact() shrinks every slot to its object, so the unused tail of a
+// reused hole goes away with the free slots
+void test_compact_drops_slot_tails() {
+  somm::PolyVector<Shape> vector;
+  vector.emplace_back<Tag>();
+  vector.emplace_back<Block>();
+  vector.emplace_back<Tag>();
+  vector.free(1);
+  CHECK(vector.emplace<Tag>() == 1);
+
+  vector.compact();
+  auto stats = vector.stats();
+  CHECK(stats.buffer_bytes == 3 * sizeof(Tag));
+  CHECK(stats.padding_bytes == 0);
+  CHECK(total(vector) == 3);
+}
+
+// A minimum alignment raised after the objects were placed asks compact()
+// for more room than the freed slot gives back. No object may be moved over
+// one that has not moved yet.
+void test_compact_after_raising_min_alignment() {
+  somm::PolyVector<Shape, somm::ContiguousStorage<somm::cache_line_size>>
+      vector;
+  for (int i = 0; i < 20; ++i) {
+    size_t index = vector.emplace_back<Tag>();
+    static_cast<Tag *>(vector[index])->id = index;
+  }
+  vector.free(0);
+  vector.set_min_alignment(somm::cache_line_size);
+
+  vector.compact();
+  for (size_t index = 1; index < vector.size(); ++index)
+    CHECK(static_cast<Tag *>(vector[index])->id == index);
+}
+
+// A handle stays valid while its object lives, even when compaction moves
+// the object, and goes stale on every path that destroys it
+void test_handles_follow_their_object() {
+  somm::PolyVector<Shape> vector;
+  for (int i = 0; i < 8; ++i)
+    vector.emplace_back<Tag>();
+  auto low = vector.handle(2);
+  auto high = vector.handle(6);
+  CHECK(vector.valid(low) && vector.get(high) == vector[6]);
+
+  vector.free(2);
+  CHECK(!vector.valid(low) && vector.get(low) == nullptr);
+  CHECK(vector.emplace<Tag>() == 2);
+  CHECK(!vector.valid(low));
+  auto reused = vector.handle(2);
+  CHECK(vector.valid(reused) && !(reused == low));
+
+  vector.free(0);
+  vector.compact();
+  CHECK(vector.get(reused) == vector[2] && vector.get(high) == vector[6]);
+
+  std::array<size_t, 2> batch = {6, 6};
+  vector.free(std::span<const size_t>(batch));
+  CHECK(!vector.valid(high) && vector.valid(reused));
+  vector.free_if([](Shape &) { return true; });
+  CHECK(!vector.valid(reused));
+
+  bool thrown = false;
+  try {
+    vector.handle(2);
+  } catch (const std::out_of_range &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+
+  // Indices restart after clear(), and a slot past the new size only holds
+  // generations older than its handles
+  auto last = vector.handle(vector.emplace_back<Tag>());
+  vector.clear();
+  CHECK(!vector.valid(last));
+  vector.emplace_back<Tag>();
+  CHECK(!vector.valid(last) && vector.valid(vector.handle(0)));
+  while (vector.size() <= last.index)
+    vector.emplace_back<Tag>();
+  CHECK(!vector.valid(last));
+}
+
+// Threads append through one appender until its bytes run out while
+// another reads the published prefix. finish() trims the unused elements
+// and the vector then knows every appended object's type.
+void test_concurrent_appender_from_threads() {
+  somm::PolyVector<Shape> vector;
+  for (int i = 0; i < 3; ++i)
+    vector.emplace_back<Tag>();
+  vector.free(1);
+  const size_t base = vector.size();
+  constexpr size_t threads = 4, attempts = 300, elements = 1000;
+
+  std::array<std::vector<size_t>, threads> appended;
+  std::atomic<size_t> exhausted = 0;
+  std::atomic<bool> done = false;
+  bool monotonic = true, readable = true;
+  {
+    auto appender = vector.concurrent_appender(16 * 1024, elements);
+    std::thread reader([&] {
+      size_t seen = appender.published_size();
+      while (!done.load()) {
+        size_t published = appender.published_size();
+        monotonic = monotonic && published >= seen;
+        for (size_t index = seen; index < published; ++index)
+          readable = readable && appender[index] != nullptr &&
+                     appender[index]->value() >= 1;
+        seen = published;
+      }
+    });
+    std::vector<std::thread> writers;
+    for (size_t t = 0; t < threads; ++t) {
+      writers.emplace_back([&, t] {
+        for (size_t i = 0; i < attempts; ++i) {
+          size_t index = (i % 2 == 0)
+                             ? appender.emplace_back<Tag>()
+                             : appender.emplace_back<Named>("short");
+          if (index == appender.npos)
+            ++exhausted;
+          else
+            appended[t].push_back(index);
+        }
+      });
+    }
+    for (auto &writer : writers)
+      writer.join();
+    done = true;
+    reader.join();
+    size_t total = 0;
+    for (const auto &indices : appended)
+      total += indices.size();
+    CHECK(appender.published_size() == base + total);
+    appender.finish();
+  }
+  CHECK(monotonic && readable);
+  CHECK(exhausted > 0);
+
+  std::vector<size_t> indices;
+  size_t tags = 0;
+  for (size_t t = 0; t < threads; ++t) {
+    for (size_t index : appended[t]) {
+      indices.push_back(index);
+      tags += dynamic_cast<Tag *>(vector[index]) != nullptr;
+    }
+  }
+  std::sort(indices.begin(), indices.end());
+  CHECK(std::adjacent_find(indices.begin(), indices.end()) == indices.end());
+  CHECK(indices.size() < elements);
+  CHECK(vector.size() == base + indices.size());
+  CHECK(indices.front() == base && indices.back() == vector.size() - 1);
+
+  CHECK(vector.view<Tag>().size() == tags + 2);
+  CHECK(vector.view<Named>().size() == indices.size() - tags);
+  CHECK(vector.stats().live_bytes ==
+        (tags + 2) * sizeof(Tag) + (indices.size() - tags) * sizeof(Named));
+  CHECK(vector.emplace<Tag>() == 1);
+  CHECK(vector.emplace_back<Tag>() == base + indices.size());
+}
+
+// Freed and reused slots leave and join the view of their type in index
+// order
+void test_view_follows_free_and_reuse() {
+  somm::PolyVector<Shape> vector;
+  for (size_t i = 0; i < 350; ++i) {
+    size_t index =
+        (i < 300) ? vector.emplace_back<Tag>() : vector.emplace<Tag>();
+    static_cast<Tag *>(vector[index])->id = index;
+    if (i == 299) {
+      for (size_t freed = 0; freed < 300; freed += 3)
+        vector.free(freed);
+    }
+  }
+
+  size_t count = 0;
+  size_t last = 0;
+  for (Tag &tag : vector.view<Tag>()) {
+    CHECK(count == 0 || tag.id > last);
+    CHECK(vector[tag.id] == &tag);
+    last = tag.id;
+    ++count;
+  }
+  CHECK(count == vector.view<Tag>().size());
+  CHECK(count == vector.size() - vector.free_count());
+}
+
+// Tags numbered by index, with frees at both ends, at word boundaries of
+// the occupancy bitmap and over one whole bitmap word
+somm::PolyVector<Shape> numbered_tags(std::vector<size_t> &live) {
+  somm::PolyVector<Shape> vector;
+  for (size_t i = 0; i < 300; ++i)
+    static_cast<Tag *>(vector[vector.emplace_back<Tag>()])->id = i;
+  std::vector<size_t> freed = {0, 1, 63, 64, 65, 299};
+  for (size_t index = 128; index < 192; ++index)
+    freed.push_back(index);
+  vector.free(std::span<const size_t>(freed));
+  live.clear();
+  for (size_t index = 0; index < vector.size(); ++index) {
+    if (vector[index] != nullptr)
+      live.push_back(index);
+  }
+  return vector;
+}
+
+// Walks a random-access range of the Tags above every way its iterator
+// moves: ++, --, +=, -=, + and - by steps that cross freed runs, and the
+// distance between two iterators
+template <typename Range>
+void check_live_iterators(const Range &range, const std::vector<size_t> &live) {
+  using iterator = decltype(range.begin());
+  static_assert(std::random_access_iterator<iterator>);
+  auto id = [](const Shape &shape) {
+    return static_cast<const Tag &>(shape).id;
+  };
+  auto rank_of = [](size_t rank) { return static_cast<std::ptrdiff_t>(rank); };
+  const iterator begin = range.begin(), end = range.end();
+  CHECK(end - begin == rank_of(live.size()));
+
+  size_t rank = 0;
+  for (iterator it = begin; it != end; ++it, ++rank)
+    CHECK(it.index() == live[rank] && id(*it) == live[rank]);
+  CHECK(rank == live.size());
+  for (iterator it = end; it != begin;) {
+    --it;
+    --rank;
+    CHECK(it.index() == live[rank] && id(*it) == live[rank]);
+  }
+
+  for (rank = 0; rank <= live.size(); ++rank) {
+    iterator it = begin;
+    it += rank_of(rank);
+    CHECK(it - begin == rank_of(rank));
+    CHECK(end - it == rank_of(live.size() - rank));
+    CHECK(it == rank_of(rank) + begin);
+    CHECK(it == end - rank_of(live.size() - rank));
+    if (rank == live.size()) {
+      CHECK(it == end);
+      continue;
+    }
+    CHECK(it.index() == live[rank] && id(begin[rank_of(rank)]) == live[rank]);
+    for (size_t step : {size_t(1), size_t(7), size_t(64)}) {
+      if (step > rank)
+        break;
+      iterator back = it - rank_of(step);
+      CHECK(back.index() == live[rank - step] && back < it);
+      back += rank_of(step);
+      CHECK(back == it);
+      back -= rank_of(step);
+      CHECK(back.index() == live[rank - step]);
+    }
+    if (rank > 0) {
+      iterator before = it;
+      CHECK(before-- == it);
+      CHECK(before.index() == live[rank - 1] && before + 1 == it);
+    }
+  }
+}
+
+// The frozen iterator follows the rank table over freed indices, and skips
+// it when nothing was freed
+void test_frozen_iterators_skip_freed_indices() {
+  std::vector<size_t> live;
+  auto frozen = numbered_tags(live).freeze();
+  CHECK(frozen.live_count() == live.size() && frozen.size() == 300);
+  check_live_iterators(frozen, live);
+
+  somm::PolyVector<Shape> dense;
+  for (size_t i = 0; i < 100; ++i)
+    static_cast<Tag *>(dense[dense.emplace_back<Tag>()])->id = i;
+  live.resize(100);
+  for (size_t i = 0; i < 100; ++i)
+    live[i] = i;
+  check_live_iterators(std::move(dense).freeze(), live);
+}
+
+// live() counts the live elements before each bitmap word once, then
+// moves like the frozen iterator, through a const vector as well
+void test_live_view_iterators_skip_freed_indices() {
+  std::vector<size_t> live;
+  auto vector = numbered_tags(live);
+  check_live_iterators(vector.live(), live);
+  const auto &view = std::as_const(vector);
+  check_live_iterators(view.live(), live);
+  static_assert(std::ranges::sized_range<decltype(view.live())>);
+  CHECK(vector.live().size() == live.size());
+
+  vector.free(live.back());
+  live.pop_back();
+  vector.free(live.front());
+  live.erase(live.begin());
+  check_live_iterators(vector.live(), live);
+}
+
+// Counts its live copies through a counter it does not own
+struct Counted final : Shape {
+  explicit Counted(size_t *alive) : alive(alive) { ++*alive; }
+  Counted(const Counted &other) : alive(other.alive) { ++*alive; }
+  ~Counted() override { --*alive; }
+
+  size_t value() const override { return 1; }
+
+  size_t *alive;
+};
+
+// A read-only frozen vector makes its pages writable again to run each
+// live object's destructor exactly once, on destruction and on move
+// assignment
+void test_read_only_freeze_destroys_on_release() {
+  size_t alive = 0;
+  {
+    somm::PolyVector<Shape> vector;
+    for (int i = 0; i < 10; ++i)
+      vector.emplace_back<Counted>(&alive);
+    vector.free(4);
+    auto frozen = std::move(vector).freeze(true);
+    CHECK(alive == 9 && vector.size() == 0);
+#ifdef SOMM_HAS_VIRTUAL_STORAGE
+    CHECK(frozen.read_only());
+#endif
+
+    somm::PolyVector<Shape> other;
+    for (int i = 0; i < 3; ++i)
+      other.emplace_back<Counted>(&alive);
+    frozen = std::move(other).freeze(true);
+    CHECK(alive == 3 && frozen.live_count() == 3);
+  }
+  CHECK(alive == 0);
+}
+
+// Padding an append adds to a free last slot has to reach its free list
+// entry, or the hole is handed out twice
+void test_append_pads_free_last_slot() {
+  somm::PolyVector<Shape, somm::ContiguousStorage<32>> vector;
+  for (int i = 0; i < 3; ++i)
+    vector.emplace_back<Tag>();
+  vector.free(2);
+  vector.emplace_back<Wide>();
+
+  size_t first = vector.emplace<Tag>();
+  size_t second = vector.emplace<Tag>();
+  CHECK(first == 2);
+  CHECK(second != first);
+  CHECK(vector.free_count() == 0);
+}
+
+// Pages of 64 words make appends skip to the next page often, which pads
+// the slot before them
+void test_paged_churn_keeps_slots_apart() {
+  somm::PolyVector<Shape, somm::PagedStorage<64>> vector;
+  std::vector<size_t> ids; // ids[index] when live, SIZE_MAX when free
+  std::mt19937 rng(7);
+  auto insert = [&](bool reuse) {
+    size_t index = 0;
+    switch (rng() % 3) {
+    case 0:
+      index = reuse ? vector.emplace<Tag>() : vector.emplace_back<Tag>();
+      break;
+    case 1:
+      index = reuse ? vector.emplace<Named>("named")
+                    : vector.emplace_back<Named>("named");
+      break;
+    default:
+      index = reuse ? vector.emplace<Wide>() : vector.emplace_back<Wide>();
+      break;
+    }
+    CHECK(index < vector.size());
+    if (index >= ids.size())
+      ids.resize(index + 1, SIZE_MAX);
+    CHECK(ids[index] == SIZE_MAX);
+    ids[index] = index;
+    if (auto *tag = dynamic_cast<Tag *>(vector[index]))
+      tag->id = index;
+  };
+
+  for (int i = 0; i < 200; ++i)
+    insert(false);
+  for (int round = 0; round < 5000; ++round) {
+    size_t index = rng() % vector.size();
+    if (ids[index] != SIZE_MAX) {
+      vector.free(index);
+      ids[index] = SIZE_MAX;
+    }
+    insert(rng() % 4 != 0);
+  }
+
+  size_t live = 0;
+  for (size_t index = 0; index < vector.size(); ++index) {
+    CHECK((vector[index] != nullptr) == (ids[index] != SIZE_MAX));
+    if (auto *tag = dynamic_cast<Tag *>(vector[index]))
+      CHECK(tag->id == index);
+    live += (ids[index] != SIZE_MAX);
+  }
+  CHECK(vector.size() - vector.free_count() == live);
+}
+
+// The default buffer only guarantees max_align_t, and a larger alignment is
+// opted into through the storage policy
+void test_storage_alignment_is_a_policy() {
+  somm::PolyVector<Shape> narrow;
+  bool rejected = false;
+  try {
+    narrow.set_min_alignment(somm::cache_line_size);
+  } catch (const std::invalid_argument &) {
+    rejected = true;
+  }
+  CHECK(rejected);
+
+  somm::PolyVector<Shape, somm::ContiguousStorage<somm::cache_line_size>> wide;
+  wide.set_min_alignment(somm::cache_line_size);
+  for (int i = 0; i < 100; ++i) {
+    size_t index =
+        (i % 2) ? wide.emplace_back<Wide>() : wide.emplace_back<Tag>();
+    auto address = reinterpret_cast<std::uintptr_t>(wide[index]);
+    CHECK(address % somm::cache_line_size == 0);
+  }
+}
+
+// A throwing predicate must leave every element it has not freed live, and
+// free nothing at all
+void test_free_if_survives_throwing_predicate() {
+  somm::PolyVector<Shape> vector;
+  for (int i = 0; i < 200; ++i) {
+    if (i % 2)
+      vector.emplace_back<Named>("a name too long for the small buffer");
+    else
+      vector.emplace_back<Tag>();
+  }
+  size_t before = total(vector);
+  size_t seen = 0;
+  bool thrown = false;
+  try {
+    vector.free_if([&](Shape &) {
+      if (++seen == 150)
+        throw std::runtime_error("predicate");
+      return true;
+    });
+  } catch (const std::runtime_error &) {
+    thrown = true;
+  }
+  CHECK(thrown);
+  CHECK(vector.free_count() == 0);
+  CHECK(total(vector) == before);
+
+  CHECK(vector.free_if([](Shape &) { return true; }) == 200);
+  CHECK(total(vector) == 0);
+}
+
+using ImageVector = somm::PolyVector<Shape, somm::ContiguousStorage<32>>;
+
+std::string image_path(const char *name) {
+  return (std::filesystem::temp_directory_path() / name).string();
+}
+
+std::vector<unsigned char> read_image(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  return {std::istreambuf_iterator<char>(file), {}};
+}
+
+void write_image(const std::string &path,
+                 const std::vector<unsigned char> &image) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char *>(image.data()),
+             static_cast<std::streamsize>(image.size()));
+}
+
+template <typename T>
+void patch_image(std::vector<unsigned char> &image, size_t at, T value) {
+  std::memcpy(image.data() + at, &value, sizeof(value));
+}
+
+// Tags, Wides and a free slot, with the registry for them
+ImageVector image_vector(somm::TypeRegistry<Shape> &registry) {
+  registry.add<Tag>(1);
+  registry.add<Wide>(2);
+  ImageVector vector;
+  for (size_t i = 0; i < 10; ++i) {
+    if (i % 3 == 2) {
+      vector.emplace_back<Wide>();
+    } else {
+      size_t index = vector.emplace_back<Tag>();
+      static_cast<Tag *>(vector[index])->id = index;
+    }
+  }
+  vector.free(4);
+  return vector;
+}
+
+template <typename Function> bool load_throws(Function &&load) {
+  try {
+    load();
+  } catch (const std::runtime_error &) {
+    return true;
+  }
+  return false;
+}
+
+// An image restores every index, free slot and type, and an empty vector
+// round-trips too
+void test_save_load_round_trip() {
+  somm::TypeRegistry<Shape> registry;
+  ImageVector vector = image_vector(registry);
+  std::string path = image_path("poly_vector_test_round_trip.bin");
+  vector.save(path, registry);
+
+  ImageVector loaded;
+  loaded.emplace_back<Wide>();
+  loaded.load(path, registry);
+  CHECK(loaded.size() == vector.size());
+  CHECK(loaded.free_count() == 1);
+  CHECK(loaded[4] == nullptr);
+  CHECK(loaded.view<Wide>().size() == vector.view<Wide>().size());
+  for (size_t index = 0; index < vector.size(); ++index) {
+    if (auto *tag = dynamic_cast<Tag *>(vector[index]))
+      CHECK(static_cast<Tag *>(loaded[index])->id == tag->id);
+  }
+  CHECK(loaded.stats().live_bytes == vector.stats().live_bytes);
+  CHECK(loaded.emplace<Tag>() == 4);
+
+  ImageVector().save(path, registry);
+  loaded.load(path, registry);
+  CHECK(loaded.size() == 0);
+  std::filesystem::remove(path);
+}
+
+// Malformed images throw std::runtime_error instead of being trusted. The
+// header and type table are checked before the vector changes.
+void test_load_rejects_malformed_images() {
+  somm::TypeRegistry<Shape> registry;
+  ImageVector vector = image_vector(registry);
+  std::string path = image_path("poly_vector_test_malformed.bin");
+  vector.save(path, registry);
+  const std::vector<unsigned char> image = read_image(path);
+  // The header is 48 bytes, followed by 16 bytes per type, the 11 offsets,
+  // the 10 slot sizes, one occupancy word and the buffer
+  constexpr size_t elements_at = 16;
+  constexpr size_t offsets_at = 48 + 2 * 16;
+  constexpr size_t slot_words_at = offsets_at + 11 * sizeof(size_t);
+  constexpr size_t buffer_at =
+      slot_words_at + 10 * sizeof(size_t) + sizeof(uint64_t);
+
+  ImageVector loaded;
+  loaded.emplace_back<Tag>();
+
+  std::vector<unsigned char> huge = image;
+  // elements + 1 and the occupancy word count both wrap to 0
+  patch_image<uint64_t>(huge, elements_at, UINT64_MAX);
+  patch_image<uint64_t>(huge, elements_at + 8, 0);
+  write_image(path, huge);
+  CHECK(load_throws([&] { loaded.load(path, registry); }));
+  CHECK(loaded.size() == 1 && loaded[0] != nullptr);
+
+  somm::TypeRegistry<Shape> tags_only;
+  tags_only.add<Tag>(1);
+  write_image(path, image);
+  CHECK(load_throws([&] { loaded.load(path, tags_only); }));
+  CHECK(loaded.size() == 1 && loaded[0] != nullptr);
+
+  for (size_t cut : {image.size() - 8, offsets_at + 8, size_t(20)}) {
+    write_image(path, {image.begin(), image.begin() + std::ptrdiff_t(cut)});
+    CHECK(load_throws([&] { loaded.load(path, registry); }));
+  }
+
+  // Index 5 is a Wide at word 12 after the free slot [10, 12). Moving its
+  // start, and its ID, to word 10 keeps every slot large enough.
+  std::vector<unsigned char> misaligned = image;
+  patch_image<size_t>(misaligned, offsets_at + 5 * sizeof(size_t), 10);
+  patch_image<uint64_t>(misaligned, buffer_at + 10 * 8, 2);
+  write_image(path, misaligned);
+  CHECK(load_throws([&] { loaded.load(path, registry); }));
+  CHECK(loaded.size() == 0);
+
+  // Index 1 is a Tag at word 2, and a slot of 3 words runs into the Wide at
+  // word 4
+  std::vector<unsigned char> overlapping = image;
+  patch_image<size_t>(overlapping, slot_words_at + 1 * sizeof(size_t), 3);
+  write_image(path, overlapping);
+  CHECK(load_throws([&] { loaded.load(path, registry); }));
+  CHECK(loaded.size() == 0);
+
+  write_image(path, image);
+  loaded.load(path, registry);
+  CHECK(loaded.size() == vector.size());
+  std::filesystem::remove(path);
+}
+
+} // namespace
+
+int main() {
+  test_reserve_and_shrink_relocate();
+  test_copy_and_move_own_their_objects();
+  test_copy_of_uncopyable_type_throws();
+  test_move_between_memory_resources();
+  test_tables_use_the_allocator();
+  test_compact_moves_overlapping_objects();
+  test_free_during_compaction_keeps_stats();
+  test_reused_hole_keeps_its_rest_free();
+  test_compact_drops_slot_tails();
+  test_compact_after_raising_min_alignment();
+  test_handles_follow_their_object();
+  test_concurrent_appender_from_threads();
+  test_view_follows_free_and_reuse();
+  test_frozen_iterators_skip_freed_indices();
+  test_read_only_freeze_destroys_on_release();
+  test_live_view_iterators_skip_freed_indices();
+  test_append_pads_free_last_slot();
+  test_paged_churn_keeps_slots_apart();
+  test_storage_alignment_is_a_policy();
+  test_free_if_survives_throwing_predicate();
+  test_save_load_round_trip();
+  test_load_rejects_malformed_images();
+  std::puts("poly_vector_test: all tests passed");
+}